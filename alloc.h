@@ -0,0 +1,150 @@
+#pragma once
+
+// Arena for the GMP/MPFR limbs of REAL, INTEGER and RATIONAL temporaries, and counting of heap allocations
+//
+// For measurements only: including this header replaces the global operator new and the GMP memory
+// functions of the whole program. It is included by alloctest.cc (make alloctest), never by the library headers.
+//
+// The arena carves blocks out of chunks it gets from malloc. Each block starts with a header giving its
+// size class, and freed blocks are kept in free lists of the thread by class and handed out again.
+// Blocks outside the chunks, e.g. allocated by GMP before the arena was installed, or too large for a class,
+// are passed to free() and realloc() instead, so the sizes GMP passes back are never trusted.
+// allocationCount counts C++ allocations (operator new), and the chunks and blocks the arena got from malloc.
+//
+// REQUIRE: included in a single file, the one with compute()
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <gmp.h>
+
+std::atomic<long long> allocationCount(0);
+
+void *operator new(size_t n) {
+  allocationCount++;
+  void *p = malloc(n);
+  if(p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+
+// size classes 2^c bytes, header included; the header keeps the blocks 16-byte aligned
+#define ARENA_MIN_CLASS   5
+#define ARENA_MAX_CLASS   16
+#define ARENA_HEADER      16
+#define ARENA_CHUNK       ((size_t)1 << 22)
+#define ARENA_MAX_CHUNKS  1024
+
+struct ArenaBlock {
+  ArenaBlock *next;
+};
+
+// chunks are only added, under the mutex; arenaChunkCount publishes them to the other threads
+char *arenaChunks[ARENA_MAX_CHUNKS];
+std::atomic<int> arenaChunkCount(0);
+std::mutex arenaChunkMutex;
+
+thread_local ArenaBlock *arenaFreeList[ARENA_MAX_CLASS+1];
+thread_local char *arenaNext = NULL, *arenaEnd = NULL;     // unused part of the last chunk of the thread
+
+void *arenaMalloc(size_t n) {
+  allocationCount++;
+  void *p = malloc(n);
+  if(p == NULL) {
+    // GMP cannot handle a failed allocation
+    fprintf(stderr, "arena: out of memory\n");
+    abort();
+  }
+  return p;
+}
+
+// whether p lies in a chunk of the arena
+bool arenaOwns(void *p) {
+  uintptr_t a = (uintptr_t)p;
+  int n = arenaChunkCount.load(std::memory_order_acquire);
+  for(int k=0 ; k<n ; k++) {
+    uintptr_t lo = (uintptr_t)arenaChunks[k];
+    if(lo <= a && a < lo + ARENA_CHUNK) return true;
+  }
+  return false;
+}
+
+// the least c >= ARENA_MIN_CLASS with n + ARENA_HEADER <= 2^c
+int arenaClass(size_t n) {
+  int c = ARENA_MIN_CLASS;
+  while(((size_t)1 << c) < n + ARENA_HEADER) c++;
+  return c;
+}
+
+// a new block of class c from the chunk of the thread, or NULL if no more chunks can be added
+char *arenaCarve(int c) {
+  size_t size = (size_t)1 << c;
+  if(arenaNext == NULL || (size_t)(arenaEnd - arenaNext) < size) {
+    std::lock_guard<std::mutex> lock(arenaChunkMutex);
+    int n = arenaChunkCount.load(std::memory_order_relaxed);
+    if(n == ARENA_MAX_CHUNKS) return NULL;
+    char *chunk = (char *)arenaMalloc(ARENA_CHUNK);
+    arenaChunks[n] = chunk;
+    arenaChunkCount.store(n+1, std::memory_order_release);
+    arenaNext = chunk;
+    arenaEnd = chunk + ARENA_CHUNK;
+  }
+  char *b = arenaNext;
+  arenaNext += size;
+  return b;
+}
+
+void *arenaAlloc(size_t n) {
+  int c = arenaClass(n);
+  if(c > ARENA_MAX_CLASS) return arenaMalloc(n);
+
+  char *b = (char *)arenaFreeList[c];
+  if(b != NULL) arenaFreeList[c] = ((ArenaBlock *)b)->next;
+  else if((b = arenaCarve(c)) == NULL) return arenaMalloc(n);
+  *(int *)b = c;
+  return b + ARENA_HEADER;
+}
+
+void arenaFree(void *p, size_t) {
+  if(!arenaOwns(p)) {
+    free(p);
+    return;
+  }
+  char *b = (char *)p - ARENA_HEADER;
+  int c = *(int *)b;
+  ((ArenaBlock *)b)->next = arenaFreeList[c];
+  arenaFreeList[c] = (ArenaBlock *)b;
+}
+
+void *arenaRealloc(void *p, size_t, size_t n) {
+  if(!arenaOwns(p)) {
+    allocationCount++;
+    void *q = realloc(p, n);
+    if(q == NULL) {
+      fprintf(stderr, "arena: out of memory\n");
+      abort();
+    }
+    return q;
+  }
+
+  int c = *(int *)((char *)p - ARENA_HEADER);
+  size_t capacity = ((size_t)1 << c) - ARENA_HEADER;
+  if(n <= capacity) return p;
+  void *q = arenaAlloc(n);
+  memcpy(q, p, capacity);
+  arenaFree(p, capacity);
+  return q;
+}
+
+struct ArenaInstaller {
+  ArenaInstaller() { mp_set_memory_functions(arenaAlloc, arenaRealloc, arenaFree); }
+};
+ArenaInstaller arenaInstaller;
@@ -0,0 +1,38 @@
+#include <string>
+
+#include "iRRAM/lib.h"
+#include "iRRAM/core.h"
+#include "iRRAM.h"
+
+using namespace iRRAM;
+
+#include "path.h"
+#include "surface.h"
+#include "primitive.h"
+#include "bvh.h"
+#include "alloc.h"
+
+
+// allocations of a membership test, once the modulus, the centers and the arena are warm
+template <int N>
+long long warmAllocations(Compact<N> &K, const Point<N> &pt, int p) {
+  K.member(pt, p);
+  K.member(pt, p);
+  long long before = allocationCount;
+  K.member(pt, p);
+  return allocationCount - before;
+}
+
+void compute() {
+  Surface<2> surface([=](REAL u, REAL v) -> Point<2> {
+    return Point<2>({2*pi()*u, sin(2*pi()*u)*v});
+  });
+  Point<2> pt({REAL(1), REAL(0)});
+  cout << "surface: " << std::to_string(warmAllocations<2>(surface, pt, 8)) << " allocations per member()\n";
+
+  Ball<2> ball({RATIONAL(0), RATIONAL(0)}, RATIONAL(1));
+  Segment<2> segment({RATIONAL(2), RATIONAL(0)}, {RATIONAL(3), RATIONAL(1)});
+  Union<2> both({&ball, &segment});
+  Point<2> q({REAL(2.5), REAL(0.5)});
+  cout << "union: " << std::to_string(warmAllocations<2>(both, q, 8)) << " allocations per member()\n";
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "iRRAM/lib.h"
+#include "iRRAM/core.h"
+#include "iRRAM.h"
+#include "compact.h"
+#include "euclidean.h"
+
+using namespace iRRAM;
+
+// Bounding volume hierarchy over the bounding boxes of compacts
+// Components without a known bounding box are kept aside and always tested.
+template <int N>
+class BVH {
+public:
+  // node of the tree
+  // leaf >= 0: the index of the component; otherwise two children
+  struct Node {
+    Box<N> box;
+    int left, right, leaf;
+  };
+
+  std::vector<Compact<N>*> components;
+  std::vector<Box<N>> boxes;            // boxes[k] is the box of components[k]
+  std::vector<bool> bounded;            // whether boxes[k] is known
+  std::vector<int> unbounded;           // components without a box
+  std::vector<Node> nodes;              // nodes[0] is the root
+  
+  BVH(const std::vector<Compact<N>*> &components) {
+    this->components = components;
+    this->boxes.resize(components.size());
+    this->bounded.resize(components.size());
+
+    std::vector<int> items;
+    for(int k=0 ; k<(int)components.size() ; k++) {
+      this->bounded[k] = components[k]->boundingBox(this->boxes[k]);
+      if(this->bounded[k]) items.push_back(k);
+      else this->unbounded.push_back(k);
+    }
+
+    // approximate centers of boxes, only used to balance the tree
+    this->mid.resize(components.size());
+    for(int k : items)
+      for(int i=0 ; i<N ; i++)
+        this->mid[k][i] = ((this->boxes[k].lo[i] + this->boxes[k].hi[i]) / REAL(2)).as_double();
+
+    if(!items.empty()) build(items, 0, items.size());
+  }
+
+  // true:  the distance from the point to the box is more than 2^-p
+  // false: on every axis, the point is within 2^(-p+1) of the box
+  static bool far(const Box<N> &box, const Point<N> &pt, int p) {
+    REAL r = Exp(-p), r2 = Exp(-p+1);
+    for(int i=0 ; i<N ; i++) {
+      if(choose(pt[i] < box.lo[i] - r, pt[i] > box.lo[i] - r2) == 1) return true;
+      if(choose(pt[i] > box.hi[i] + r, pt[i] < box.hi[i] + r2) == 1) return true;
+    }
+    return false;
+  }
+
+  // call visit(k) for the component k, bounded or not, which may be within 2^-p of the point
+  // Stop and return true as soon as visit returns true.
+  // The stack of the traversal is kept between the queries, so a query allocates nothing.
+  template <class Visit>
+  bool any(const Point<N> &pt, int p, Visit visit) {
+    if(!this->nodes.empty()) {
+      this->stack.clear();
+      this->stack.push_back(0);
+      while(!this->stack.empty()) {
+        const Node &node = this->nodes[this->stack.back()];
+        this->stack.pop_back();
+        if(far(node.box, pt, p)) continue;
+        if(node.leaf >= 0) {
+          if(visit(node.leaf)) return true;
+        } else {
+          this->stack.push_back(node.right);
+          this->stack.push_back(node.left);
+        }
+      }
+    }
+    for(int k : this->unbounded)
+      if(visit(k)) return true;
+    return false;
+  }
+
+private:
+  std::vector<std::array<double, N>> mid;
+  std::vector<int> stack;               // scratch of any()
+
+  // build a subtree on items[from, to) and return its index
+  int build(std::vector<int> &items, int from, int to) {
+    int index = this->nodes.size();
+    this->nodes.push_back(Node());
+
+    // hull of boxes
+    Box<N> hull = this->boxes[items[from]];
+    for(int k=from+1 ; k<to ; k++) {
+      for(int i=0 ; i<N ; i++) {
+        hull.lo[i] = minimum(hull.lo[i], this->boxes[items[k]].lo[i]);
+        hull.hi[i] = maximum(hull.hi[i], this->boxes[items[k]].hi[i]);
+      }
+    }
+
+    int left = -1, right = -1, leaf = -1;
+    if(to - from == 1) {
+      leaf = items[from];
+    } else {
+      // split at the median along the axis where the centers spread most
+      int axis = 0;
+      double spread = -1;
+      for(int i=0 ; i<N ; i++) {
+        double lo = this->mid[items[from]][i], hi = lo;
+        for(int k=from+1 ; k<to ; k++) {
+          lo = std::min(lo, this->mid[items[k]][i]);
+          hi = std::max(hi, this->mid[items[k]][i]);
+        }
+        if(hi - lo > spread) { spread = hi - lo; axis = i; }
+      }
+      int half = (from + to) / 2;
+      std::nth_element(items.begin()+from, items.begin()+half, items.begin()+to,
+                       [&](int a, int b) { return this->mid[a][axis] < this->mid[b][axis]; });
+      left = build(items, from, half);
+      right = build(items, half, to);
+    }
+
+    Node &node = this->nodes[index];
+    node.box = hull;
+    node.left = left;
+    node.right = right;
+    node.leaf = leaf;
+    return index;
+  }
+};
+
+
+// union of many compacts
+// A point is only tested against the components whose bounding boxes are near to it,
+// which is sound since member(pt, p) of a compact K is false whenever d(pt, K) > 2^-p.
+template <int N>
+class Union : public Compact<N> {
+public:
+  BVH<N> bvh;
+
+  // REQUIRE: the components live as long as the union
+  Union(const std::vector<Compact<N>*> &components) : bvh(components) {}
+
+  bool member(const Point<N> &point, int p) {
+    single_valued code;
+    return this->bvh.any(point, p, [&](int k) -> bool {
+      return this->bvh.components[k]->member(point, p);
+    });
+  }
+
+  // let the components prepare their membership tests, so that their moduli are cached too
+  void increasePrecision(int p) {
+    for(Compact<N> *com : this->bvh.components) com->increasePrecision(p);
+  }
+
+  // hull of the boxes of the components
+  bool boundingBox(Box<N> &box) {
+    if(!this->bvh.unbounded.empty()) return false;
+    if(this->bvh.nodes.empty()) return false;
+    box = this->bvh.nodes[0].box;
+    return true;
+  }
+
+  // union of the samples of the components
+  bool sample(int p, std::vector<Point<N>> &points) {
+    points.clear();
+    std::vector<Point<N>> part;
+    for(Compact<N> *com : this->bvh.components) {
+      if(!com->sample(p, part)) return false;
+      points.insert(points.end(), part.begin(), part.end());
+    }
+    return true;
+  }
+};
+
+
+// intersection of many compacts
+// A point far from the bounding box of any component is rejected
+// before any membership test of the components.
+// Samples of the components say nothing of their intersection, so an intersection cannot be sampled.
+template <int N>
+class Intersection : public Compact<N> {
+public:
+  BVH<N> bvh;
+
+  // REQUIRE: the components live as long as the intersection
+  Intersection(const std::vector<Compact<N>*> &components) : bvh(components) {}
+
+  bool member(const Point<N> &point, int p) {
+    single_valued code;
+    if(this->bvh.components.empty()) return false;
+    for(int k=0 ; k<(int)this->bvh.components.size() ; k++)
+      if(this->bvh.bounded[k] && BVH<N>::far(this->bvh.boxes[k], point, p)) return false;
+    for(Compact<N> *com : this->bvh.components)
+      if(!com->member(point, p)) return false;
+    return true;
+  }
+
+  void increasePrecision(int p) {
+    for(Compact<N> *com : this->bvh.components) com->increasePrecision(p);
+  }
+
+  // any box of the components bounds the intersection
+  bool boundingBox(Box<N> &box) {
+    for(int k=0 ; k<(int)this->bvh.components.size() ; k++) {
+      if(this->bvh.bounded[k]) {
+        box = this->bvh.boxes[k];
+        return true;
+      }
+    }
+    return false;
+  }
+};
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <chrono>
+#include <cstring>
+#include <string>
+
 #include "euclidean.h"
 #include "iRRAM/lib.h"
 #include "iRRAM/core.h"
@@ -13,63 +17,231 @@ using namespace iRRAM;
 #define PLOT_COLOR_G    0x00
 #define PLOT_COLOR_B    0x00
 
+// plot2D modes
+#define PLOT_RESUMABLE  0x01    // keep finished pixels over the reiterations of compute()
+#define PLOT_COHERENT   0x02    // visit pixels along the Morton curve instead of row by row
+
+// number of pixels stored in a single cached int; keeps the sign bit unused
+#define PLOT_CACHE_BLOCK  31
+
+// centers of balls kept by Path and Surface: CENTER_CACHE_SIDE^2 slots, direct-mapped by index
+#define CENTER_CACHE_SIDE  64
+
+
+// counters read by the profiling of raster2D
+// Compacts count the work done in their membership tests here.
+struct ProfileCounters {
+  long long centers = 0;          // ball centers tested
+};
+ProfileCounters profileCounters;
+
+// pixel geometry of a 2D plot
+// area to draw: [x1, x2] X [y1, y2]
+// Set image width. Height will be determined automatically.
+// REQUIRE: x1 < x2, y1 < y2
+struct Viewport {
+  int width, height;
+  int p;                      // precision of the membership test of a pixel
+  REAL x1, y1, pixelSize;
+
+  Viewport(int width, REAL x1, REAL x2, REAL y1, REAL y2) {
+    this->width = width;
+    this->x1 = x1;
+    this->y1 = y1;
+    this->pixelSize = (x2-x1)/REAL(width);      // single pixel size as a rect
+    this->height = ceil(((y2-y1)/pixelSize).as_double());               // image height
+
+    // precision
+    // Define p such that a ball centered at the center of pixel cover the pixel
+    // That is, pixelSize/2*sqrt(2)  <  2^-p (radius of ball)
+    // The drawn path will not be broken.
+    this->p = floor((REAL(0.5) - log(pixelSize)/ln2()).as_double());
+  }
+
+  // coordinates of the center of the pixel in column j and in row i, row 0 at the top
+  REAL x(int j) const { return x1 + pixelSize * REAL(2*j+1) / REAL(2); }
+  REAL y(int i) const { return y1 + pixelSize * REAL(2*(height-1-i)+1) / REAL(2); }
+};
+
+// save a raster to an .png file in PLOT_COLOR
+// In black, the default, the raster is written as a 1-bit image without expanding it into a Palette.
+void writePlot(const char *filename, const Bitmap &bm) {
+  if(PLOT_COLOR_R == 0 && PLOT_COLOR_G == 0 && PLOT_COLOR_B == 0) {
+    writeImage(filename, bm);
+    return;
+  }
+
+  Palette pal(bm.width, bm.height);
+  for(int i=0 ; i<bm.height ; i++) {
+    for(int j=0 ; j<bm.width ; j++) {
+      if(bm.get(j, i)) pal.setColor(j, i, PLOT_COLOR_R, PLOT_COLOR_G, PLOT_COLOR_B);
+    }
+  }
+  writeImage(filename, pal);
+}
 
 // R^N
 template <int N>
 class Compact {
 public:
   // characteristic function
-  std::function< bool (Point<N> , int) > cfun;
+  std::function< bool (const Point<N> &, int) > cfun;
 
   // init with the emptyset
-  Compact() { this->cfun = [=](Point<N>, int) -> bool { return false; }; }
+  Compact() { this->cfun = [=](const Point<N> &, int) -> bool { return false; }; }
 
   // init with characteristic func
-  Compact(std::function<bool(Point<N>, int)> cfun) { this->cfun = cfun; }
+  Compact(std::function<bool(const Point<N> &, int)> cfun) { this->cfun = cfun; }
 
   // membership test for point with precision 2^-p
-  virtual bool member(Point<N> point, int p) { return this->cfun(point, p); }
+  virtual bool member(const Point<N> &point, int p) { return this->cfun(point, p); }
+
+  // preparation of the membership test for a characteristic function built from other compacts, if any
+  // e.g. conjunction() passes increasePrecision on to its operands with it.
+  std::function< void (int) > prepare;
+
+  // prepare the membership test with precision 2^-p in advance
+  // Path and Surface find their modulus here, Union and Intersection pass it on to their components.
+  // For a plain characteristic function, only prepare is called.
+  virtual void increasePrecision(int p) { if(this->prepare) this->prepare(p); }
+
+  // certified bounding box of the set
+  // Return false if no bound is known.
+  virtual bool boundingBox(Box<N> &box) { return false; }
+
+  // finite set of points within Hausdorff distance 2^-p of the set
+  // Return false if the set cannot be sampled.
+  virtual bool sample(int p, std::vector<Point<N>> &points) { return false; }
 
   
-  // save the 2D graph to an .png file
+  // test every pixel of the 2D graph
   // area to draw: [x1, x2] X [y1, y2]
   // Set image width. Height will be determined automatically.
+  // Row 0 of the raster is the top of the area.
+  // mode: bitwise or of PLOT_* flags
+  // If profile is given, the cost of each pixel is recorded in it.
   // REQUIRE: x1 < x2, y1 < y2
-  void plot2D(const char *filename, int width, REAL x1, REAL x2, REAL y1, REAL y2) {
+  Bitmap raster2D(int width, REAL x1, REAL x2, REAL y1, REAL y2, int mode = 0, Profile *profile = NULL) {
     // only plane
-    if(N != 2) return;
+    if(N != 2) return Bitmap(0, 0);
 
-    // some values..
-    REAL pixelSize = (x2-x1)/REAL(width);      // single pixel size as a rect
-    int height = ceil(((y2-y1)/pixelSize).as_double());               // image height
+    Viewport vp(width, x1, x2, y1, y2);
 
-    // precision
-    // Define p such that a ball centered at the center of pixel cover the pixel
-    // That is, pixelSize/2*sqrt(2)  <  2^-p (radius of ball)
-    // The drawn path will not be broken.
-    int p = floor((REAL(0.5) - log(pixelSize)/ln2()).as_double());       // precision
+    // With PLOT_RESUMABLE, the modulus is found here, outside of any single_valued block,
+    // so that it can be cached as well.
+    if(mode & PLOT_RESUMABLE) this->increasePrecision(vp.p);
+
+    // With PLOT_COHERENT, consecutive pixels are mostly neighbours,
+    // so that member() of Path and Surface finds the ball of the previous pixel at once.
+    std::vector<std::array<int,2>> order = pixelOrder(vp.width, vp.height, (mode & PLOT_COHERENT) != 0);
+    Bitmap bm(vp.width, vp.height);
+    if(profile) *profile = Profile(vp.width, vp.height);
+    rasterPixels(vp, order, bm, mode, profile, true);
+
+    return bm;
+  }
+
+  // test the pixels of the viewport in the given order, as (column, row) pairs, and set them in bm
+  // Pixels are tested in blocks of PLOT_CACHE_BLOCK.
+  // In resumable mode, a finished block is put into the iRRAM cache as a bit mask, and
+  // when compute() is reiterated after a failed comparison, it is read back instead of tested again.
+  // The profile of a finished block is cached along with it, three ints per pixel,
+  // so that it records the cost and the precision of the iteration in which the pixel was tested.
+  // If verbose, the progress is printed in units of rows.
+  void rasterPixels(const Viewport &vp, const std::vector<std::array<int,2>> &order, Bitmap &bm,
+                    int mode, Profile *profile, bool verbose) {
+    bool resumable = (mode & PLOT_RESUMABLE) != 0;
 
-    // plot each pixel to palette
-    // start at the bottom row, from left to right.. row += 1 .. repeat
     // variable point stores the coordinate of the center of the current pixel
-    Point<N> point = {REAL(0), y1 - pixelSize/2};      // init with coordinate outside image
-    Palette pal(width, height);
-    for(int i=height-1 ; i>=0 ; i--) {
-      point[0] = x1 + pixelSize/2;    // x; the left most pixel
-      point[1] += pixelSize;          // y; +1 row
-
-      for(int j=0 ; j<width ; j++) {
-        if(member(point, p)) {
-          pal.setColor(j, i, PLOT_COLOR_R, PLOT_COLOR_G, PLOT_COLOR_B);
+    Point<N> point;
+    for(size_t k0=0 ; k0<order.size() ; k0+=PLOT_CACHE_BLOCK) {
+      size_t k1 = std::min(order.size(), k0+PLOT_CACHE_BLOCK);
+      int bits = 0;
+      if(resumable && cacheGet(bits)) {
+        if(profile) {
+          for(size_t k=k0 ; k<k1 ; k++) {
+            size_t index = (size_t)order[k][1]*vp.width + order[k][0];
+            int t = 0, centers = 0, prec = 0;
+            cacheGet(t);
+            cacheGet(centers);
+            cacheGet(prec);
+            std::memcpy(&profile->time[index], &t, sizeof(float));
+            profile->centers[index] = centers;
+            profile->precision[index] = prec;
+          }
+        }
+      } else {
+        for(size_t k=k0 ; k<k1 ; k++) {
+          int j = order[k][0], i = order[k][1];
+          point[0] = vp.x(j);
+          point[1] = vp.y(i);
+          long long centers = 0;
+          std::chrono::steady_clock::time_point start;
+          if(profile) {
+            centers = profileCounters.centers;
+            start = std::chrono::steady_clock::now();
+          }
+          bool in;
+          if(resumable) {
+            // choices made inside member() must not go into the cache between the blocks
+            single_valued code;
+            in = member(point, vp.p);
+          } else {
+            in = member(point, vp.p);
+          }
+          if(in) bits |= 1 << (k-k0);
+          if(profile) {
+            size_t index = (size_t)i*vp.width + j;
+            profile->time[index] = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            profile->centers[index] = profileCounters.centers - centers;
+            profile->precision[index] = ACTUAL_STACK.actual_prec;
+          }
+        }
+        if(resumable) {
+          cachePut(bits);
+          if(profile) {
+            for(size_t k=k0 ; k<k1 ; k++) {
+              size_t index = (size_t)order[k][1]*vp.width + order[k][0];
+              int t;
+              std::memcpy(&t, &profile->time[index], sizeof(float));
+              cachePut(t);
+              cachePut((int)profile->centers[index]);
+              cachePut(profile->precision[index]);
+            }
+          }
         }
-        point[0] += pixelSize;
       }
 
-      cout << (height-i) << " / " << height << " row done\n";
+      for(size_t k=k0 ; k<k1 ; k++) {
+        if(bits & (1 << (k-k0))) bm.set(order[k][0], order[k][1]);
+        if(verbose && (k+1) % vp.width == 0) cout << (k+1)/vp.width << " / " << vp.height << " row done\n";
+      }
     }
+  }
+
+  // save the 2D graph to an .png file
+  // arguments as in raster2D
+  void plot2D(const char *filename, int width, REAL x1, REAL x2, REAL y1, REAL y2, int mode = 0) {
+    // only plane
+    if(N != 2) return;
+
+    Bitmap bm = raster2D(width, x1, x2, y1, y2, mode);
+    writePlot(filename, bm);
+  }
+
+  // plot2D with profiling
+  // Besides the graph, the cost of each pixel is saved
+  // as a heatmap to <profileName>.png and as raw arrays to <profileName>.raw. (check Profile)
+  void plot2DProfile(const char *filename, const char *profileName, int width, REAL x1, REAL x2, REAL y1, REAL y2, int mode = 0) {
+    // only plane
+    if(N != 2) return;
+
+    Profile prof;
+    Bitmap bm = raster2D(width, x1, x2, y1, y2, mode, &prof);
+    writePlot(filename, bm);
 
-    // to image
-    writeImage(filename, pal);
+    writeHeatmap((std::string(profileName) + ".png").c_str(), prof);
+    prof.writeRaw((std::string(profileName) + ".raw").c_str());
   }
 };
 
@@ -79,19 +251,23 @@ public:
 // pointwise conjunction for binary Boolean functions
 template <int N>
 Compact<N> conjunction(Compact<N> &com1, Compact<N> &com2) {
-  auto cfun = [&] (Point<N> pt, int p) -> bool {
+  auto cfun = [&] (const Point<N> &pt, int p) -> bool {
     return com1.member(pt, p) && com2.member(pt, p);
   };
-  return Compact<N>(cfun);
+  Compact<N> res(cfun);
+  res.prepare = [&] (int p) { com1.increasePrecision(p); com2.increasePrecision(p); };
+  return res;
 }
   
 // pointwise conjunction for binary Boolean functions
 template <int N>
 Compact<N> disjunction(Compact<N> &com1, Compact<N> &com2) {
-  auto cfun = [&] (Point<N> pt, int p) -> bool {
+  auto cfun = [&] (const Point<N> &pt, int p) -> bool {
     return com1.member(pt, p) || com2.member(pt, p);
   };
-  return Compact<N>(cfun);
+  Compact<N> res(cfun);
+  res.prepare = [&] (int p) { com1.increasePrecision(p); com2.increasePrecision(p); };
+  return res;
 }
 
 
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+#include "iRRAM/lib.h"
+#include "iRRAM/core.h"
+#include "iRRAM.h"
+#include "compact.h"
+#include "euclidean.h"
+#include "primitive.h"
+#include "bvh.h"
+
+using namespace iRRAM;
+
+/*
+  Distance to a compact and Hausdorff distance between compacts
+
+  A compact is split through its unions into primitives (check Primitive::distanceTo()), whose distances
+  are exact, and the other parts, which are sampled (check Compact::sample()).
+  The samples are rounded to dyadic points so that nearest neighbours are found by exact comparisons.
+  With samples within 2^(-p-2) of the sets and rounding errors at most 2^(-p-3) on each point,
+  the results are approximations with error at most 2^-p.
+  The points of a primitive are never sampled: the farthest ones from the other compact
+  are found by branch and bound over dyadic cubes (check partsHausdorff()).
+*/
+
+// k-d tree of dyadic points, for nearest neighbour queries
+// points[from, to) is a subtree: its root is at mid = (from+to)/2, and splits it
+// on the coordinate depth % N into points[from, mid) below and points[mid+1, to) above.
+template <int N>
+class SampleIndex {
+public:
+  std::vector<RationalPoint<N>> points;
+
+  SampleIndex() {}
+
+  // round the points with error 2^-q on each coordinate
+  SampleIndex(const std::vector<Point<N>> &samples, int q) {
+    this->points.reserve(samples.size());
+    for(const Point<N> &s : samples) this->points.push_back(dyadicApprox<N>(s, q));
+    this->build(0, this->points.size(), 0);
+  }
+
+  // squared distance from x to the nearest point
+  // If some point is found within sqrt(enough), return at once an upper bound <= enough.
+  // REQUIRE: some point
+  RATIONAL nearest2(const RationalPoint<N> &x, const RATIONAL *enough = NULL) const {
+    RATIONAL best = ZERO;
+    bool found = false;
+    this->nearest(x, 0, this->points.size(), 0, enough, best, found);
+    return best;
+  }
+
+private:
+  void build(int from, int to, int depth) {
+    if(to - from <= 1) return;
+    int mid = (from + to) / 2, axis = depth % N;
+    std::nth_element(this->points.begin() + from, this->points.begin() + mid, this->points.begin() + to,
+                     [axis](const RationalPoint<N> &a, const RationalPoint<N> &b) { return a[axis] < b[axis]; });
+    this->build(from, mid, depth + 1);
+    this->build(mid + 1, to, depth + 1);
+  }
+
+  // the side of x first; the other side only if the gap to the split is less than the best distance so far
+  void nearest(const RationalPoint<N> &x, int from, int to, int depth, const RATIONAL *enough,
+               RATIONAL &best, bool &found) const {
+    if(from >= to) return;
+    if(found && enough && best <= *enough) return;
+
+    int mid = (from + to) / 2, axis = depth % N;
+    const RationalPoint<N> &s = this->points[mid];
+    RATIONAL d2 = RP_d2<N>(x, s);
+    if(!found || d2 < best) best = d2;
+    found = true;
+
+    RATIONAL gap = x[axis] - s[axis];
+    bool below = gap < ZERO;
+    if(below) this->nearest(x, from, mid, depth + 1, enough, best, found);
+    else this->nearest(x, mid + 1, to, depth + 1, enough, best, found);
+    if(gap * gap < best) {
+      if(below) this->nearest(x, mid + 1, to, depth + 1, enough, best, found);
+      else this->nearest(x, from, mid, depth + 1, enough, best, found);
+    }
+  }
+};
+
+// precision of rounding: error 2^(-p-3) in Euclidean distance
+template <int N>
+int roundingPrecision(int p) {
+  return p+3+sqrtExponent(N);
+}
+
+// K split through its unions into its nonempty primitives and the rounded samples of the other parts
+// Throw std::invalid_argument if K is empty or some part cannot be sampled.
+template <int N>
+class CompactParts {
+public:
+  std::vector<Primitive<N>*> primitives;
+  SampleIndex<N> index;
+
+  CompactParts(Compact<N> &K, int p) {
+    std::vector<Point<N>> samples;
+    if(!this->split(K, p, samples))
+      throw std::invalid_argument("a compact cannot be sampled");
+    if(this->primitives.empty() && samples.empty())
+      throw std::invalid_argument("a compact is empty");
+    this->index = SampleIndex<N>(samples, roundingPrecision<N>(p));
+  }
+
+  // distance from x to the parts, exact for the primitives
+  REAL distanceTo(const RationalPoint<N> &x) const {
+    bool found = !this->index.points.empty();
+    REAL d = found ? distanceOf2(this->index.nearest2(x)) : REAL(0);
+    for(Primitive<N> *prim : this->primitives) {
+      d = found ? minimum(d, prim->distanceTo(x)) : prim->distanceTo(x);
+      found = true;
+    }
+    return d;
+  }
+
+private:
+  bool split(Compact<N> &K, int p, std::vector<Point<N>> &samples) {
+    if(Primitive<N> *prim = dynamic_cast<Primitive<N>*>(&K)) {
+      RationalPoint<N> lo, hi;
+      if(prim->exactBox(lo, hi)) this->primitives.push_back(prim);
+      return true;
+    }
+    if(Union<N> *u = dynamic_cast<Union<N>*>(&K)) {
+      for(Compact<N> *com : u->bvh.components)
+        if(!this->split(*com, p, samples)) return false;
+      return true;
+    }
+
+    std::vector<Point<N>> part;
+    if(!K.sample(p+2, part)) return false;
+    samples.insert(samples.end(), part.begin(), part.end());
+    return true;
+  }
+};
+
+// distance from the point to K with error at most 2^-p
+// REQUIRE: K is nonempty, and its parts other than primitives can be sampled, e.g. Path, Surface
+// Throw std::invalid_argument otherwise.
+template <int N>
+REAL distance(Compact<N> &K, const Point<N> &pt, int p) {
+  CompactParts<N> parts(K, p);
+  return parts.distanceTo(dyadicApprox<N>(pt, roundingPrecision<N>(p)));
+}
+
+// max of the distances from the points of A to the points of B, squared
+// Once a point of A is found within the current max from B, it cannot raise the max,
+// so its search stops at once.
+template <int N>
+RATIONAL directedHausdorff2(const SampleIndex<N> &A, const SampleIndex<N> &B) {
+  RATIONAL cmax = ZERO;
+  for(const RationalPoint<N> &a : A.points) {
+    RATIONAL d2 = B.nearest2(a, &cmax);
+    if(cmax < d2) cmax = d2;
+  }
+  return cmax;
+}
+
+// max of the distances from the samples of A to the parts B, with error at most 2^(-p-5)
+// Raise lb to a lower bound of it.
+template <int N>
+REAL samplesHausdorff(const CompactParts<N> &A, const CompactParts<N> &B, int p, RATIONAL &lb) {
+  if(A.index.points.empty()) return REAL(0);
+
+  RATIONAL e = Exp(-p-5);
+  if(B.primitives.empty()) {
+    REAL h = distanceOf2(directedHausdorff2<N>(A.index, B.index));
+    RATIONAL d = dyadicApprox(h, p+5) - e;
+    if(lb < d) lb = d;
+    return h;
+  }
+
+  RATIONAL cmax = ZERO;
+  for(const RationalPoint<N> &a : A.index.points) {
+    RATIONAL D = dyadicApprox(B.distanceTo(a), p+5);
+    if(cmax < D) cmax = D;
+  }
+  if(lb < cmax - e) lb = cmax - e;
+  return REAL(cmax);
+}
+
+// cube of half side 2^j around c, of the primitive source s, and the bound D+e+r of the distances from its points
+template <int N>
+struct HausdorffCube {
+  RATIONAL bound;
+  RationalPoint<N> c;
+  int j, s;
+
+  bool operator<(const HausdorffCube<N> &o) const { return this->bound < o.bound; }
+};
+
+// Hausdorff distance between the parts P1 and P2 with error less than 2^(-p-2)
+// The samples are checked one by one. The points of the primitives are not sampled: dyadic cubes
+// covering their boxes are bisected while their half diagonals r = 2^(j+h) >= sqrt(N)*2^j exceed 2^(-p-5),
+// and D approximates the distance from the center c to the other parts with error e = 2^(-p-5).
+// A cube with d(c, A) >= 2r misses its primitive A and is dropped. Otherwise some point of A is within 2r of c,
+// so the distance is at least lb >= D-e-2r, and a cube with D+e+r <= lb + 2^(-p-3) can be dropped.
+// The cubes of the primitives of both sides share one queue by decreasing D+e+r, so that the larger direction
+// prunes the other one, e.g. when a set lies in the other one. The first leaf bounds all the other cubes.
+// The work grows with the measure of the points of the primitives whose distance is near the max.
+template <int N>
+REAL partsHausdorff(const CompactParts<N> &P1, const CompactParts<N> &P2, int p) {
+  RATIONAL lb = ZERO;
+  REAL h = maximum(samplesHausdorff<N>(P1, P2, p, lb), samplesHausdorff<N>(P2, P1, p, lb));
+
+  std::vector<std::pair<Primitive<N>*, const CompactParts<N>*>> sources;
+  for(Primitive<N> *prim : P1.primitives) sources.push_back({prim, &P2});
+  for(Primitive<N> *prim : P2.primitives) sources.push_back({prim, &P1});
+  if(sources.empty()) return h;
+
+  int hN = sqrtExponent(N), leaf = -p-5-hN;
+  RATIONAL e = Exp(-p-5), tol = Exp(-p-3);
+  std::priority_queue<HausdorffCube<N>> queue;
+  auto push = [&](int s, const RationalPoint<N> &c, int j) {
+    RATIONAL r = Exp(j+hN);
+    if(!sources[s].first->within(c, r + r)) return;
+    RATIONAL D = dyadicApprox(sources[s].second->distanceTo(c), p+5);
+    if(D + e + r <= lb + tol) return;
+    if(lb < D - e - r - r) lb = D - e - r - r;
+    queue.push({D + e + r, c, j, s});
+  };
+
+  for(int s=0 ; s<(int)sources.size() ; s++) {
+    RationalPoint<N> lo, hi, c;
+    sources[s].first->exactBox(lo, hi);
+    RATIONAL side = ZERO;
+    for(int i=0 ; i<N ; i++) {
+      c[i] = (lo[i] + hi[i]) / INTEGER(2);
+      if(side < hi[i] - c[i]) side = hi[i] - c[i];
+    }
+    int j = leaf;
+    while(Exp(j) < side) j++;
+    push(s, c, j);
+  }
+
+  while(!queue.empty()) {
+    HausdorffCube<N> cube = queue.top();
+    queue.pop();
+    if(cube.bound <= lb + tol) break;           // so are all the others
+    if(cube.j <= leaf) return maximum(h, REAL(cube.bound));
+
+    // the 2^N subcubes, c +- 2^(j-1) on each coordinate
+    RATIONAL half = Exp(cube.j - 1);
+    for(int k=0 ; k<(1<<N) ; k++) {
+      RationalPoint<N> sub;
+      for(int i=0 ; i<N ; i++) sub[i] = (k >> i & 1) ? cube.c[i] + half : cube.c[i] - half;
+      push(cube.s, sub, cube.j - 1);
+    }
+  }
+  return maximum(h, REAL(lb + tol));
+}
+
+// Hausdorff distance between K1 and K2 with error at most 2^-p
+// The parts are within 3*2^(-p-3) of the sets, so their Hausdorff distance is within 3*2^(-p-2).
+// REQUIRE: K1 and K2 are nonempty, and their parts other than primitives can be sampled, as in distance()
+// Throw std::invalid_argument otherwise.
+template <int N>
+REAL hausdorff(Compact<N> &K1, Compact<N> &K2, int p) {
+  CompactParts<N> P1(K1, p), P2(K2, p);
+  return partsHausdorff<N>(P1, P2, p);
+}
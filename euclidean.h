@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <climits>
+#include <stdexcept>
+#include <vector>
 #include "iRRAM.h"
 
 using namespace iRRAM;
@@ -21,6 +25,17 @@ using Point = IR<N>;
 template <int N>
 using DyadicPoint = std::array<DYADIC, N>;
 
+// Point with exact rational coordinates
+template <int N>
+using RationalPoint = std::array<RATIONAL, N>;
+
+
+// Axis-aligned box [lo[0],hi[0]] X ... X [lo[N-1],hi[N-1]]
+template <int N>
+struct Box {
+  Point<N> lo, hi;
+};
+
 
 #define ZERO    RATIONAL(INTEGER(0),INTEGER(1))
 #define ONE     RATIONAL(INTEGER(1),INTEGER(1))
@@ -39,6 +54,39 @@ RATIONAL Exp(int n)
     return (RATIONAL(INTEGER(1), INTEGER(1) << -n));
 }
 
+// the least h >= 0 with sqrt(n) <= 2^h
+// e.g. the diagonal of a cube of side s in R^n is at most 2^h * s
+int sqrtExponent(int n)
+{
+  int h = 0;
+  while ((1 << (2 * h)) < n)
+    h++;
+  return h;
+}
+
+// INTEGER of a long long, e.g. of an index of a ball beyond the range of int
+// REQUIRE: 0 <= k < 2^62
+INTEGER toINTEGER(long long k)
+{
+  return (INTEGER((int)(k >> 31)) << 31) + INTEGER((int)(k & 0x7fffffff));
+}
+
+// dyadic approximation of x with error at most 2^-q, as an exact rational
+RATIONAL dyadicApprox(const REAL &x, int q)
+{
+  return RATIONAL(scale(x, q).as_INTEGER()) * Exp(-q);
+}
+
+// coordinatewise dyadic approximation with error at most 2^-q
+template <int N>
+RationalPoint<N> dyadicApprox(const Point<N> &x, int q)
+{
+  RationalPoint<N> res;
+  for (int i = 0; i < N; i++)
+    res[i] = dyadicApprox(x[i], q);
+  return res;
+}
+
 template <int N>
 IR<N> IR_origin()
 {
@@ -48,19 +96,38 @@ IR<N> IR_origin()
   return res;
 }
 
-// metric
+// squared metric
 template <int N>
-REAL IR_d(IR<N> x, IR<N> y)
+REAL IR_d2(const IR<N> &x, const IR<N> &y)
 {
   REAL sum = 0;
-  REAL a, b;
   for (int i = 0; i < N; i++)
   {
-    a = x[i];
-    b = y[i];
-    sum += (a - b) * (a - b);
+    REAL a = x[i] - y[i];
+    sum += a * a;
   }
-  return sqrt(sum);
+  return sum;
+}
+
+// metric
+template <int N>
+REAL IR_d(const IR<N> &x, const IR<N> &y)
+{
+  return sqrt(IR_d2<N>(x, y));
+}
+
+// iRRAM hands back the values put into its cache in the same order
+// when compute() is reiterated with a higher precision.
+// As in module(), the cache is used only outside of limits and single_valued blocks.
+bool cacheGet(int &x)
+{
+  return (ACTUAL_STACK.inlimit == 0) && iRRAM_thread_data_address->cache_i.get(x);
+}
+
+void cachePut(int x)
+{
+  if (ACTUAL_STACK.inlimit == 0)
+    iRRAM_thread_data_address->cache_i.put(x);
 }
 
 // Copied from iRRAM/src/stack.cc and modified a little.
@@ -185,6 +252,136 @@ int module(std::function<REAL(REAL)> f, const REAL &x, int p)
 }
 
 
+// Batched moduli, without the exception per probe of module()
+//
+// A probe evaluates f once on a whole interval, i.e. on a REAL whose error covers the interval,
+// and succeeds if the error of the result is at most 2^(p-1); no approx() is called.
+// Then |f(x)-f(z)| <= 2^p for all z in the interval.
+// Only when f itself compares numbers, an Iteration may still be caught.
+
+// true if the error of x is at most 2^p
+bool errorBelow(const REAL &x, int p)
+{
+  sizetype err;
+  x.geterror(err);
+
+  // err = mantissa * 2^exponent < 2^(exponent + bit length of mantissa)
+  int e = err.exponent;
+  for (unsigned int m = err.mantissa; m > 0; m >>= 1)
+    e++;
+  return err.mantissa == 0 || e <= p;
+}
+
+// true if f on the interval x +- 2^e is evaluated with an error at most 2^(p-1)
+bool moduleProbe(std::function<REAL(REAL)> f, REAL x, int e, int p)
+{
+  sizetype err;
+  sizetype_set(err, 1, e);
+  x.adderror(err);
+  try
+  {
+    single_valued code;
+    return errorBelow(f(x), p - 1);
+  }
+  catch (Iteration it)
+  {
+    return false;
+  }
+}
+
+// depth below p down to which moduleSearch probes
+#define MODULE_SEARCH_DEPTH  64
+
+// Return: the largest e <= 0 with probe(e), searched from the guess,
+//         or INT_MIN if the batched search gives up
+// probe is supposed to be monotone. Before searching below p, pointOk() tells
+// whether f(x) itself is precise enough for any probe to succeed; if not, or if no probe
+// succeeds down to p - MODULE_SEARCH_DEPTH, the search gives up.
+int moduleSearch(std::function<bool(int)> probe, std::function<bool()> pointOk, int guess, int p)
+{
+  int e = std::min(guess, 0);
+  bool checked = false;
+  if (probe(e))
+  {
+    while (e < 0 && probe(e + 1))
+      e++;
+  }
+  else
+  {
+    do
+    {
+      e--;
+      if (e < p && !checked)
+      {
+        if (!pointOk())
+          return INT_MIN;
+        checked = true;
+      }
+      if (e < p - MODULE_SEARCH_DEPTH)
+        return INT_MIN;
+    } while (!probe(e));
+  }
+  return e;
+}
+
+// true if f(x) is evaluated with an error at most 2^(p-2),
+// leaving a margin for the probes, which need 2^(p-1) on a whole interval
+bool modulePointOk(std::function<REAL(REAL)> f, const REAL &x, int p)
+{
+  try
+  {
+    single_valued code;
+    return errorBelow(f(x), p - 2);
+  }
+  catch (Iteration it)
+  {
+    return false;
+  }
+}
+
+// module() in place of a batched search that gave up
+// It throws Iteration when x or the working precision is not enough, and reiterates as usual.
+// Whether a search gives up may change between iterations, so the cache of module() is not used.
+int moduleFallback(std::function<REAL(REAL)> f, const REAL &x, int p)
+{
+  single_valued code;
+  return module(f, x, p);
+}
+
+// Semantics: If m = module_batch(f, xs, p), then
+//    |xs[k]-z| <= 2^m[k] implies |f(xs[k])-f(z)| <= 2^p
+// The search at each point starts from the result at the previous one.
+std::vector<int> module_batch(std::function<REAL(REAL)> f, const std::vector<REAL> &xs, int p)
+{
+  std::vector<int> result(xs.size());
+  int guess = p;
+  for (size_t k = 0; k < xs.size(); k++)
+  {
+    const REAL &x = xs[k];
+    int e = moduleSearch(
+        [&](int e) -> bool { return moduleProbe(f, x, e, p); },
+        [&]() -> bool { return modulePointOk(f, x, p); },
+        guess, p);
+    if (e == INT_MIN)
+      e = moduleFallback(f, x, p);
+    else
+      guess = e;
+    result[k] = e;
+  }
+  return result;
+}
+
+// Return: e such that |f(x)-f(z)| <= 2^p for all z in [x, x+2^e], searched from the guess
+// used to step through an interval, with the previous step as the guess.
+int cellModule(std::function<REAL(REAL)> f, const RATIONAL &x, int p, int guess)
+{
+  int e = moduleSearch(
+      [&](int e) -> bool { return moduleProbe(f, REAL(x + Exp(e - 1)), e - 1, p); },
+      [&]() -> bool { return modulePointOk(f, REAL(x), p); },
+      guess, p);
+  return e == INT_MIN ? moduleFallback(f, REAL(x), p) : e;
+}
+
 
 
 // Return: the minimum q such that
@@ -250,3 +447,87 @@ int module2(std::function<Point<N>(Point<M>)> f, int p) {
   c.fill(REAL(1) / REAL(2));
   return module2_<M,N>(f,p,c,0);
 }
+
+// Return: q >= 0 such that
+//         for any hypercube H of size 2^-q in [0,1]^M,
+//         f(H) is subset of a hypercube of size 2^-p
+// when f: R^M -> R^N is Lipschitz continuous with the constant L (in Euclidean metric).
+// Unlike module2, no evaluation of f is needed:
+// the diameter of f(H) is at most L * sqrt(M) * 2^-q, so q = p+k where L * sqrt(M) <= 2^k.
+template<int M>
+int lipschitzModule(const REAL &L, int p) {
+  // the choice of k need not be consistent on reiteration, as the result is cached by the callers
+  single_valued code;
+
+  REAL bound = L * sqrt(REAL(M));
+  int k = 0;
+  while(choose(bound < REAL(Exp(k)), bound > REAL(Exp(k-1))) != 1) k++;
+
+  // a single cell covers [0,1]^M already
+  return std::max(p+k, 0);
+}
+
+// depth of the bisection in derivativeBound, after which coarser bounds are accepted
+#define DERIVATIVE_BOUND_DEPTH  10
+
+// Return: L such that |df(x)| <= L for all x in hypercube H
+//         where |df(x)| is the Frobenius norm of the Jacobian, which bounds the operator norm.
+// df: R^M -> R^(N x M) given by the M columns (partial derivatives)
+// H is given with the center c and side length 2^-s
+// By the mean value theorem, L is a Lipschitz constant of f on H.
+// The squared norm is bounded first, so no square root is taken of an enclosure near 0.
+template<int M, int N>
+REAL derivativeBound_(std::function<std::array<Point<N>,M>(Point<M>)> df, const HyperCube<M> &c, int s) {
+  sizetype err;
+
+  // create H
+  HyperCube<M> box = c;
+  for(REAL &u : box) {
+    sizetype_set(err, 1, -s-1);
+    u.seterror(err);
+  }
+
+  // bound |df|^2 on the whole H at once, with an error at most 2^e
+  // Below the depth limit only e = -1 is tried; at the limit, coarser e are accepted.
+  int eMax = (s < DERIVATIVE_BOUND_DEPTH) ? -1 : 62;
+  for(int e=-1 ; e<=eMax ; e++) {
+    DYADIC d;
+    try {
+      single_valued code;
+
+      std::array<Point<N>,M> J = df(box);
+      REAL sum = 0;
+      for(Point<N> &col : J)
+        for(REAL &v : col) sum += v*v;
+      d = approx(sum, e);
+    } catch (Iteration it) { continue; }
+
+    // |df(x)|^2 <= d + 2^e on H
+    return sqrt(REAL(d) + REAL(Exp(e)));
+  }
+  if(s >= DERIVATIVE_BOUND_DEPTH)
+    throw std::runtime_error("derivativeBound: the derivative is not bounded");
+
+  // bisection on failure, total 2^M sub-hypercubes
+  REAL result = 0;
+  HyperCube<M> newCenter;
+  REAL halfLen = Exp(-s-2);
+  for(int k=0 ; k<(1<<M) ; k++) {
+    // the j'th bit of k chooses the left(0) or right(1) half section on j'th dimension
+    for(int j=0 ; j<M ; j++) {
+      int sign = ((k & (1<<j)) ? 1 : -1);
+      newCenter[j] = c[j] + REAL(INTEGER(sign)) * halfLen;
+    }
+    result = maximum(result, derivativeBound_<M,N>(df, newCenter, s+1));
+  }
+
+  return result;
+}
+
+// Return: a Lipschitz constant of f on [0,1]^M computed from its derivative df
+template<int M, int N>
+REAL derivativeBound(std::function<std::array<Point<N>,M>(Point<M>)> df) {
+  HyperCube<M> c;
+  c.fill(REAL(1) / REAL(2));
+  return derivativeBound_<M,N>(df, c, 0);
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <iostream>
+#include <csignal>
+#include <cstdio>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "iRRAM/lib.h"
+#include "iRRAM/core.h"
+#include "iRRAM.h"
+#include "compact.h"
+#include "plot.h"
+
+using namespace iRRAM;
+
+/*
+  plot2D on a farm of worker processes
+
+  The viewport is split into tiles, 64*k pixels wide so that tiles own whole words of a Bitmap row.
+  Worker processes are forked from compute() and share nothing with each other afterwards.
+  The coordinator hands the next tile to whichever worker returns one, over pipes,
+  so that slow tiles on the boundary of the set do not keep the other workers idle.
+
+  A worker cannot reiterate compute() on its own. When a comparison fails in a worker,
+  the tile is reported as failed and is then tested in the coordinator itself,
+  where the failure reiterates compute() as usual. The finished tiles are put into the
+  iRRAM cache before that, and handed back instead of farmed again on the reiteration.
+  A worker that dies of any other exception exits with status 1; its tile is tested
+  in the coordinator as well, where the exception is thrown again.
+*/
+
+// tile of the farm: pixels [j0, j1) X [i0, i1)
+struct Tile {
+  int j0, j1, i0, i1;
+};
+
+// read or write exactly n bytes; false on end of file or error
+bool readAll(int fd, void *buf, size_t n) {
+  char *p = (char *)buf;
+  while(n > 0) {
+    ssize_t r = read(fd, p, n);
+    if(r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void *buf, size_t n) {
+  const char *p = (const char *)buf;
+  while(n > 0) {
+    ssize_t r = write(fd, p, n);
+    if(r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+// words of the tile in a raster, row by row
+std::vector<uint64_t> tileWords(const Bitmap &bm, const Tile &t) {
+  std::vector<uint64_t> words;
+  for(int i=t.i0 ; i<t.i1 ; i++)
+    for(int w=t.j0/64 ; w<(t.j1+63)/64 ; w++)
+      words.push_back(bm.data[(size_t)i*bm.stride + w]);
+  return words;
+}
+
+void setTileWords(Bitmap &bm, const Tile &t, const std::vector<uint64_t> &words) {
+  size_t k = 0;
+  for(int i=t.i0 ; i<t.i1 ; i++)
+    for(int w=t.j0/64 ; w<(t.j1+63)/64 ; w++)
+      bm.data[(size_t)i*bm.stride + w] = words[k++];
+}
+
+// pixels of a tile in the order of plot2D, in the given PLOT_* mode
+std::vector<std::array<int,2>> tileOrder(const Tile &t, int mode) {
+  std::vector<std::array<int,2>> order = pixelOrder(t.j1-t.j0, t.i1-t.i0, (mode & PLOT_COHERENT) != 0);
+  for(std::array<int,2> &px : order) {
+    px[0] += t.j0;
+    px[1] += t.i0;
+  }
+  return order;
+}
+
+// worker: test the tiles sent by the coordinator until -1 arrives
+// reply: int tile, int success, then the words of the tile on success
+// Never returns; exits with status 1 on any exception other than Iteration.
+template <int N>
+void farmWorker(Compact<N> &K, const Viewport &vp, const std::vector<Tile> &tiles, int in, int out, int mode) {
+  int status = 0;
+  try {
+    Bitmap bm(vp.width, vp.height);
+    int t;
+    while(readAll(in, &t, sizeof(int)) && t >= 0 && t < (int)tiles.size()) {
+      const Tile &tile = tiles[t];
+      int success = 1;
+      try {
+        // nothing may go into the cache of the process we were forked from
+        single_valued code;
+        K.rasterPixels(vp, tileOrder(tile, mode), bm, mode & ~PLOT_RESUMABLE, NULL, false);
+      } catch (Iteration it) { success = 0; }
+
+      int header[2] = {t, success};
+      if(!writeAll(out, header, sizeof(header))) break;
+      if(success) {
+        std::vector<uint64_t> words = tileWords(bm, tile);
+        if(!writeAll(out, words.data(), words.size() * sizeof(uint64_t))) break;
+      }
+    }
+  } catch (...) { status = 1; }
+  _exit(status);
+}
+
+// put finished tiles into the iRRAM cache as a group:
+// the number of all tiles, the number of tiles in the group, then each tile and its words as pairs of ints
+void cacheTiles(const Bitmap &bm, const std::vector<Tile> &tiles, const std::vector<int> &group) {
+  if(group.empty()) return;
+  cachePut(tiles.size());
+  cachePut(group.size());
+  for(int t : group) {
+    cachePut(t);
+    for(uint64_t w : tileWords(bm, tiles[t])) {
+      cachePut((int)(uint32_t)w);
+      cachePut((int)(uint32_t)(w >> 32));
+    }
+  }
+}
+
+// read back one group of cacheTiles into bm and mark its tiles done
+// Return false when there is no group left, or it is not one of these tiles.
+bool cachedTiles(Bitmap &bm, const std::vector<Tile> &tiles, std::vector<bool> &done, int &remaining) {
+  int total, count;
+  if(!cacheGet(total) || total != (int)tiles.size() || !cacheGet(count)) return false;
+  for(int c=0 ; c<count ; c++) {
+    int t;
+    if(!cacheGet(t) || t < 0 || t >= total) return false;
+    std::vector<uint64_t> words = tileWords(bm, tiles[t]);
+    for(uint64_t &w : words) {
+      int lo, hi;
+      if(!cacheGet(lo) || !cacheGet(hi)) return false;
+      w = (uint64_t)(uint32_t)lo | ((uint64_t)(uint32_t)hi << 32);
+    }
+    setTileWords(bm, tiles[t], words);
+    if(!done[t]) remaining--;
+    done[t] = true;
+  }
+  return true;
+}
+
+// plot2D with the given number of worker processes and tiles of about tileSize pixels square
+// arguments otherwise as in Compact::plot2D; PLOT_COHERENT applies within each tile,
+// and finished tiles are always kept over a reiteration, as with PLOT_RESUMABLE.
+template <int N>
+void plot2DFarm(Compact<N> &K, const char *filename, int width, REAL x1, REAL x2, REAL y1, REAL y2,
+                int workers, int tileSize = 64, int mode = 0) {
+  // only plane
+  if(N != 2) return;
+
+  Viewport vp(width, x1, x2, y1, y2);
+
+  // find the modulus once, before forking, so that every worker inherits it
+  // Testing a pixel also builds lazily computed state, such as the centers of Path and Surface.
+  K.increasePrecision(vp.p);
+  {
+    Point<N> point;
+    point[0] = vp.x(0);
+    point[1] = vp.y(0);
+    single_valued code;
+    K.member(point, vp.p);
+  }
+
+  // tiles, 64 * k pixels wide
+  int tileWidth = std::max(64, (tileSize + 63) / 64 * 64), tileHeight = std::max(1, tileSize);
+  std::vector<Tile> tiles;
+  for(int i0=0 ; i0<vp.height ; i0+=tileHeight)
+    for(int j0=0 ; j0<vp.width ; j0+=tileWidth)
+      tiles.push_back({j0, std::min(j0+tileWidth, vp.width), i0, std::min(i0+tileHeight, vp.height)});
+
+  Bitmap bm(vp.width, vp.height);
+  std::vector<bool> done(tiles.size(), false);
+  int remaining = tiles.size();
+
+  // tiles finished before a reiteration, in groups put by cacheTiles
+  // Both the farmed and the locally tested tiles are put, so the groups cover all tiles once this plot is done,
+  // and nothing put after the plot is read here.
+  while(remaining > 0 && cachedTiles(bm, tiles, done, remaining)) {}
+
+  // farm the rest
+  std::vector<int> todo, failed, finished;
+  for(int t=0 ; t<(int)tiles.size() ; t++)
+    if(!done[t]) todo.push_back(t);
+  workers = std::max(1, std::min(workers, (int)todo.size()));
+
+  // nothing buffered may be written twice by the workers
+  std::cout.flush();
+  fflush(stdout);
+  void (*savedPipe)(int) = signal(SIGPIPE, SIG_IGN);
+
+  std::vector<pid_t> pids;
+  std::vector<int> toWorker, fromWorker, current;
+  size_t next = 0;
+  for(int w=0 ; w<workers && next<todo.size() ; w++) {
+    int task[2], result[2];
+    if(pipe(task) != 0 || pipe(result) != 0) {
+      fprintf(stderr, "plot2DFarm: could not create pipes\n");
+      break;
+    }
+    pid_t pid = fork();
+    if(pid < 0) {
+      fprintf(stderr, "plot2DFarm: could not fork\n");
+      close(task[0]); close(task[1]); close(result[0]); close(result[1]);
+      break;
+    }
+    if(pid == 0) {
+      close(task[1]);
+      close(result[0]);
+      for(int fd : toWorker) close(fd);
+      for(int fd : fromWorker) close(fd);
+      farmWorker<N>(K, vp, tiles, task[0], result[1], mode);
+    }
+    close(task[0]);
+    close(result[1]);
+    pids.push_back(pid);
+    toWorker.push_back(task[1]);
+    fromWorker.push_back(result[0]);
+    current.push_back(todo[next]);
+    writeAll(task[1], &todo[next], sizeof(int));
+    next++;
+  }
+
+  // collect tiles and hand out the next ones
+  int busy = pids.size();
+  std::vector<pollfd> fds(pids.size());
+  while(busy > 0) {
+    for(size_t w=0 ; w<pids.size() ; w++) {
+      fds[w].fd = current[w] >= 0 ? fromWorker[w] : -1;
+      fds[w].events = POLLIN;
+      fds[w].revents = 0;
+    }
+    if(poll(fds.data(), fds.size(), -1) < 0) continue;
+
+    for(size_t w=0 ; w<pids.size() ; w++) {
+      if(current[w] < 0 || !(fds[w].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+      int header[2];
+      std::vector<uint64_t> words = tileWords(bm, tiles[current[w]]);
+      bool alive = readAll(fromWorker[w], header, sizeof(header));
+      if(alive && header[1]) alive = readAll(fromWorker[w], words.data(), words.size() * sizeof(uint64_t));
+
+      if(alive && header[1]) {
+        setTileWords(bm, tiles[current[w]], words);
+        finished.push_back(current[w]);
+      } else {
+        failed.push_back(current[w]);
+      }
+
+      if(alive && next < todo.size()) {
+        current[w] = todo[next++];
+        alive = writeAll(toWorker[w], &current[w], sizeof(int));
+        if(!alive) failed.push_back(current[w]);
+      } else {
+        current[w] = -1;
+      }
+      if(current[w] < 0 || !alive) {
+        current[w] = -1;
+        busy--;
+      }
+    }
+  }
+
+  // tiles never handed out, when workers could not be started or died
+  for( ; next<todo.size() ; next++) failed.push_back(todo[next]);
+
+  int stop = -1;
+  for(size_t w=0 ; w<pids.size() ; w++) {
+    writeAll(toWorker[w], &stop, sizeof(int));
+    close(toWorker[w]);
+    close(fromWorker[w]);
+    int status = 0;
+    waitpid(pids[w], &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      fprintf(stderr, "plot2DFarm: a worker failed; its tile is tested here\n");
+  }
+  signal(SIGPIPE, savedPipe);
+
+  // keep the finished tiles over a reiteration
+  cacheTiles(bm, tiles, finished);
+
+  // failed tiles are tested here, where a failure reiterates compute()
+  for(int t : failed) {
+    single_valued code;
+    K.rasterPixels(vp, tileOrder(tiles[t], mode), bm, mode & ~PLOT_RESUMABLE, NULL, false);
+  }
+  cacheTiles(bm, tiles, failed);
+
+  writePlot(filename, bm);
+}
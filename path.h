@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 #include "iRRAM/lib.h"
 #include "iRRAM/core.h"
@@ -21,10 +24,34 @@ public:
   // init
   Path(std::function<Point<N>(REAL)> f) { this->f = f; }
 
+  // init with a Lipschitz constant L of f, i.e. |f(x)-f(z)| <= L|x-z| for all x,z in [0,1]
+  // pArg is then computed directly, without the search in module2.
+  Path(std::function<Point<N>(REAL)> f, REAL L) : Path(f) {
+    this->lipschitz = L;
+    this->lipschitzKnown = true;
+  }
+
+  // init with the derivative df of f
+  // A Lipschitz constant is obtained by evaluating df on [0,1].
+  Path(std::function<Point<N>(REAL)> f, std::function<Point<N>(REAL)> df) : Path(f) {
+    std::function<std::array<Point<N>,1>(Point<1>)> J = [=](Point<1> x) -> std::array<Point<N>,1> {
+      return {df(x[0])};
+    };
+    this->lipschitz = derivativeBound<1,N>(J);
+    this->lipschitzKnown = true;
+  }
+
+  // a certified Lipschitz constant of f, if known
+  REAL lipschitz;
+  bool lipschitzKnown = false;
+
   // whenever |x-z| < 2^-pArg, |f(x)-f(z)| < 2^-p for all x,z
   // will be increased when higher precision is requested
   int p=INT_MIN, pArg=INT_MIN;
 
+  // index of the center of the last ball that contained a point
+  long long lastHit = 0;
+
   // increase the current precision(from this->p to p)
   // and find the corresponding pArg
   void increasePrecision(int p) {
@@ -38,13 +65,22 @@ public:
     std::function<Point<N>(Point<1>)> ff = [&](Point<1> x) -> Point<N> {
       return this->f(x[0]);
     };
-    this->pArg = module2<1,N>(ff, p+1);
+    // pArg is cached, so the search is not repeated when compute() is reiterated
+    int q;
+    if(!cacheGet(q)) {
+      q = this->lipschitzKnown ? lipschitzModule<1>(this->lipschitz, p+1) : module2<1,N>(ff, p+1);
+      cachePut(q);
+    }
+    // balls are indexed by long long
+    if(q > 62) throw std::range_error("Path: more than 2^62 balls are needed");
+    this->pArg = q;
+    this->lastHit = 0;
 
     // update the current precision
     this->p = p;
 
     // update the current characteristic function
-    this->cfun = [&](Point<N> pt, int p) -> bool{
+    this->cfun = [&](const Point<N> &pt, int p) -> bool{
       single_valued code;
 
       // check the membership with previously found p and pArg
@@ -53,22 +89,103 @@ public:
       // maximum distance between two consecutive balls(centers): 2^(-p-1)*sqrt(2)   (check increasePrecision())
       // When checking inclusiveness, we run (d < radius) and (d > radius/2) in parallel for decidability.
       // For any point on the path, there exists a ball that contains the point.
-      RATIONAL step = Exp(-pArg);   // 2^-pArg
-      RATIONAL radius = Exp(-p);     // 2^-p, the radius of a ball
-      RATIONAL radiusHalf = radius/INTEGER(2);     // 2^(-p-1)
-      REAL d;
-      RATIONAL u,v;
-      for(u=step/2 ; u<=ONE ; u+=step) {
-        d = IR_d<N>(pt, this->f(u));
-        if(choose(d < radius, d > radiusHalf) == 1) return true;
+      // Distances are compared squared, to the constants kept for the last p.
+      // With the centers around the last hit cached (check ballCenter()), little is rebuilt per call.
+      if(this->radiusP != p) {
+        this->radius2 = Exp(-2*p);          // (2^-p)^2, the radius of a ball squared
+        this->radiusHalf2 = Exp(-2*p-2);    // (2^(-p-1))^2
+        this->radiusP = p;
+      }
+      REAL d2;
+
+      // centers are scanned outward from the last hit: f(step/2 + k*step) for k = h, h+1, h-1, h+2, ...
+      // Neighbouring points are mostly covered by the same or adjacent balls.
+      long long n = 1LL << pArg;     // number of centers
+      long long h = this->lastHit;
+      for(long long r=0 ; r<=std::max(h, n-1-h) ; r++) {
+        for(int side=0 ; side<(r == 0 ? 1 : 2) ; side++) {
+          long long k = side == 0 ? h+r : h-r;
+          if(k < 0 || k >= n) continue;
+          profileCounters.centers++;
+          d2 = IR_d2<N>(pt, this->ballCenter(k));
+          if(choose(d2 < this->radius2, d2 > this->radiusHalf2) == 1) {
+            this->lastHit = k;
+            return true;
+          }
+        }
       }
       return false;
     };
   }
+
+  // centers of balls at the current precision, the k'th one in the slot k mod CENTER_CACHE_SIDE^2
+  // A slot keeps the last center evaluated in it, so the scans around the last hit mostly find
+  // theirs, and the memory stays bounded whatever pArg is.
+  std::vector<Point<N>> centers;
+  std::vector<long long> centerKeys;    // index of the center in each slot, -1 if none
+  RATIONAL halfStep;                    // 2^(-pArg-1), half the step between the parameters of two centers
+  int centersP = INT_MIN;
+
+  // squared radii used by the characteristic function for the precision radiusP
+  REAL radius2, radiusHalf2;
+  int radiusP = INT_MIN;
+
+  // f(step/2 + k*step), the center of the k'th ball
+  const Point<N> &ballCenter(long long k) {
+    if(this->centersP != this->p) {
+      this->centers.resize(CENTER_CACHE_SIDE * CENTER_CACHE_SIDE);
+      this->centerKeys.assign(CENTER_CACHE_SIDE * CENTER_CACHE_SIDE, -1);
+      this->halfStep = Exp(-pArg-1);
+      this->centersP = this->p;
+    }
+    int slot = k % (CENTER_CACHE_SIDE * CENTER_CACHE_SIDE);
+    if(this->centerKeys[slot] != k) {
+      this->centers[slot] = this->f(this->halfStep * RATIONAL(toINTEGER(2*k+1)));
+      this->centerKeys[slot] = k;
+    }
+    return this->centers[slot];
+  }
+
+  // The centers at precision q are within sqrt(N)*2^(-q-1) of every point. (check increasePrecision())
+  // Hence q = p+h with sqrt(N) <= 2^h will do.
+  bool sample(int p, std::vector<Point<N>> &points) {
+    this->increasePrecision(p+sqrtExponent(N));
+    long long n = 1LL << pArg;     // number of centers
+    points.clear();
+    for(long long k=0 ; k<n ; k++) points.push_back(this->ballCenter(k));
+    return true;
+  }
   
+  // certified bounding box of the path
+  // Any precision will do, so the current one is used when there is.
+  bool boundingBox(Box<N> &box) {
+    if(this->p == INT_MIN) this->increasePrecision(0);
+
+    // the hull of the centers of balls
+    RATIONAL step = Exp(-pArg);
+    RATIONAL u;
+    bool first = true;
+    for(u=step/2 ; u<=ONE ; u+=step) {
+      Point<N> c = this->f(u);
+      for(int i=0 ; i<N ; i++) {
+        box.lo[i] = first ? c[i] : minimum(box.lo[i], c[i]);
+        box.hi[i] = first ? c[i] : maximum(box.hi[i], c[i]);
+      }
+      first = false;
+    }
+
+    // On each axis, every point is within 2^(-p-1) of the center of its cell. (check increasePrecision())
+    REAL margin = Exp(-this->p-1);
+    for(int i=0 ; i<N ; i++) {
+      box.lo[i] -= margin;
+      box.hi[i] += margin;
+    }
+    return true;
+  }
+
   // membership test for point with precision 2^-p
   // in accordance to the Ko compatibility
-  bool member (Point<N> point, int p) {
+  bool member (const Point<N> &point, int p) {
     // cout << "member in path p = " << p << "\n";
 
     // check if previously found pArg is viable
@@ -111,11 +228,12 @@ REAL OneDMin_approx(int p, std::function<REAL(REAL)> f)
 {
   RATIONAL x = 0;
   REAL m = f(x);
-  int q;
+  int q = p;
   while (x < RATIONAL(1, 1))
   {
     // cout<<"testing" <<REAL(x) <<"\n";
-    q = module(f, x, p);
+    // the step at the previous point is a good guess for this one
+    q = cellModule(f, x, p, q);
     m = minimum(f(x), m);
     x = x + Exp(q);
   }
@@ -130,19 +248,92 @@ std::function<REAL(const int &)> cast_min(Homotopy<1, 1> f)
       });
 }
 
+// Minimization of f : [0, 1] -> R, warm started over the precisions requested by limit
+// approx(p) scans only the candidate intervals kept from the previous precisions,
+// and keeps for the next one only the cells that can still contain the minimum.
+// So the work at each precision is spent around the minimizers rather than on all of [0, 1].
+class OneDOptimizer
+{
+public:
+  std::function<REAL(REAL)> f;
+
+  // intervals [a, b] which may contain a minimizer
+  std::vector<std::array<RATIONAL, 2>> candidates;
+
+  OneDOptimizer(std::function<REAL(REAL)> f)
+  {
+    this->f = f;
+    this->candidates.push_back({ZERO, ONE});
+  }
+
+  // approximates the minimum value of f in [0,1] by 2^p
+  REAL approx(int p)
+  {
+    // cells [x, x + 2^q] with |f(x) - f(z)| <= 2^p on them, as in OneDMin_approx
+    // The step q of the previous cell is the guess for the next one.
+    std::vector<std::array<RATIONAL, 2>> cells;
+    std::vector<REAL> values;
+    int q = p;
+    for (const std::array<RATIONAL, 2> &c : candidates)
+    {
+      RATIONAL x = c[0];
+      do
+      {
+        q = cellModule(f, x, p, q);
+        RATIONAL next = x + Exp(q);
+        if (c[1] < next)
+          next = c[1];
+        cells.push_back({x, next});
+        values.push_back(f(x));
+        x = next;
+      } while (x < c[1]);
+    }
+
+    REAL m = values[0];
+    for (const REAL &v : values)
+      m = minimum(v, m);
+
+    // m - 2^p <= min f <= m, so a cell with f(x) > m + 2^(p+1) has all values above min f + 2^p.
+    // Only the other cells are kept, adjacent ones merged.
+    // The candidates are replaced at the end, in case the evaluation fails in between.
+    REAL margin = scale(REAL(1), p + 1);
+    std::vector<std::array<RATIONAL, 2>> kept;
+    for (size_t k = 0; k < cells.size(); k++)
+    {
+      if (choose(values[k] > m + margin, values[k] < m + 2 * margin) == 1)
+        continue;
+      if (!kept.empty() && !(kept.back()[1] < cells[k][0]))
+        kept.back()[1] = cells[k][1];
+      else
+        kept.push_back(cells[k]);
+    }
+    candidates = kept;
+    return m;
+  }
+};
+
+std::function<REAL(const int &)> cast_min_warm(std::function<REAL(REAL)> f)
+{
+  std::shared_ptr<OneDOptimizer> opt = std::make_shared<OneDOptimizer>(f);
+  return (
+      [=](int x) -> REAL {
+        return opt->approx(x);
+      });
+}
+
 REAL OneDMin(Homotopy<1, 1> f)
 {
-  return limit(from_algorithm<REAL, int>(cast_min(f)));
+  return limit(from_algorithm<REAL, int>(cast_min_warm(as_func(f))));
 }
 
 REAL OneDMax_approx(int p, std::function<REAL(REAL)> f)
 {
   RATIONAL x = 0;
   REAL m = f(x);
-  int q;
+  int q = p;
   while (x < RATIONAL(1, 1))
   {
-    q = module(f, x, p);
+    q = cellModule(f, x, p, q);
     m = maximum(f(x), m);
     x = x + Exp(q);
   }
@@ -157,9 +348,14 @@ std::function<REAL(const int &)> cast_max(Homotopy<1, 1> f)
       });
 }
 
+// max f = -min(-f)
 REAL OneDMax(Homotopy<1, 1> f)
 {
-  return limit(from_algorithm<REAL, int>(cast_max(f)));
+  std::function<REAL(REAL)> g = as_func(f);
+  return -limit(from_algorithm<REAL, int>(cast_min_warm(
+      [=](REAL x) -> REAL {
+        return -g(x);
+      })));
 }
 
 /*
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <png.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
 
 class Palette {
 public:
@@ -32,6 +38,135 @@ public:
   }
 };
 
+// pixels (x, y) of an image in the order to be drawn, y = 0 being the top row
+// Row by row from the bottom, from left to right;
+// or along the Morton (Z-order) curve from the bottom left, where most consecutive pixels are adjacent.
+std::vector<std::array<int,2>> pixelOrder(int width, int height, bool morton) {
+  std::vector<std::array<int,2>> order;
+  order.reserve((size_t)width * height);
+  for(int i=height-1 ; i>=0 ; i--)
+    for(int j=0 ; j<width ; j++)
+      order.push_back({j, i});
+  if(!morton) return order;
+
+  // interleave the bits of x and the bits of y counted from the bottom
+  auto key = [&](const std::array<int,2> &px) -> uint64_t {
+    uint64_t x = px[0], y = height-1-px[1], res = 0;
+    for(int b=0 ; b<32 ; b++) {
+      res |= ((x >> b) & 1) << (2*b);
+      res |= ((y >> b) & 1) << (2*b+1);
+    }
+    return res;
+  };
+  std::sort(order.begin(), order.end(), [&](const std::array<int,2> &a, const std::array<int,2> &b) {
+    return key(a) < key(b);
+  });
+  return order;
+}
+
+// 1-bit occupancy raster
+// Each row is packed into 64-bit words, pixel x of a row being bit (x % 64) of word (x / 64).
+// Bits beyond the width are kept 0, so that the set operations can work on whole words.
+class Bitmap {
+public:
+  int width;
+  int height;
+  int stride;                     // number of words in a row
+  std::vector<uint64_t> data;
+
+  // init with the emptyset
+  Bitmap(int width, int height) {
+    this->width = width;
+    this->height = height;
+    this->stride = (width + 63) / 64;
+    this->data.assign((size_t)stride * height, 0);
+  }
+
+  // x,y starts with 0
+  bool get(int x, int y) const {
+    return (this->data[(size_t)y*stride + x/64] >> (x%64)) & 1;
+  }
+
+  void set(int x, int y) {
+    this->data[(size_t)y*stride + x/64] |= (uint64_t)1 << (x%64);
+  }
+
+  // number of set pixels
+  long count() const {
+    long n = 0;
+    for(uint64_t w : this->data) n += __builtin_popcountll(w);
+    return n;
+  }
+
+  // set operations on the same viewport
+  // REQUIRE: both rasters have the same size
+  Bitmap &operator&=(const Bitmap &other) {
+    for(size_t k=0 ; k<data.size() ; k++) this->data[k] &= other.data[k];
+    return *this;
+  }
+
+  Bitmap &operator|=(const Bitmap &other) {
+    for(size_t k=0 ; k<data.size() ; k++) this->data[k] |= other.data[k];
+    return *this;
+  }
+
+  Bitmap &operator^=(const Bitmap &other) {
+    for(size_t k=0 ; k<data.size() ; k++) this->data[k] ^= other.data[k];
+    return *this;
+  }
+
+  // complement within the viewport
+  Bitmap operator~() const {
+    Bitmap res = *this;
+    uint64_t last = (width % 64 == 0) ? ~(uint64_t)0 : ((uint64_t)1 << (width % 64)) - 1;
+    for(int y=0 ; y<height ; y++) {
+      uint64_t *row = &res.data[(size_t)y*stride];
+      for(int k=0 ; k<stride ; k++) row[k] = ~row[k];
+      if(stride > 0) row[stride-1] &= last;
+    }
+    return res;
+  }
+};
+
+Bitmap operator&(Bitmap a, const Bitmap &b) { return a &= b; }
+Bitmap operator|(Bitmap a, const Bitmap &b) { return a |= b; }
+Bitmap operator^(Bitmap a, const Bitmap &b) { return a ^= b; }
+
+// per pixel cost of a plot
+// Arrays are indexed like the image: y * width + x, row 0 at the top.
+class Profile {
+public:
+  int width;
+  int height;
+  std::vector<float> time;              // seconds spent in member()
+  std::vector<uint32_t> centers;        // number of ball centers tested
+  std::vector<int32_t> precision;       // iRRAM working precision (ACTUAL_STACK.actual_prec) of the test
+
+  Profile(int width = 0, int height = 0) {
+    this->width = width;
+    this->height = height;
+    this->time.assign((size_t)width * height, 0);
+    this->centers.assign((size_t)width * height, 0);
+    this->precision.assign((size_t)width * height, 0);
+  }
+
+  // raw binary: int32 width, int32 height, then the three arrays in order, in host byte order
+  void writeRaw(const char *filename) const {
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+      fprintf(stderr, "Could not open file %s for writing\n", filename);
+      return;
+    }
+    int32_t size[2] = {this->width, this->height};
+    size_t n = (size_t)width * height;
+    fwrite(size, sizeof(int32_t), 2, fp);
+    fwrite(this->time.data(), sizeof(float), n, fp);
+    fwrite(this->centers.data(), sizeof(uint32_t), n, fp);
+    fwrite(this->precision.data(), sizeof(int32_t), n, fp);
+    fclose(fp);
+  }
+};
+
 void writeImage(const char *filename, Palette &pal) {
   int width = 100, height = 100;
 	int code = 0;
@@ -104,3 +239,85 @@ void writeImage(const char *filename, Palette &pal) {
 	if (row != NULL) free(row);
 
 }
+
+
+// write a raster as a 1-bit grayscale image: set pixels black, others white
+void writeImage(const char *filename, const Bitmap &bm) {
+	FILE *fp = NULL;
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+
+	fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "Could not open file %s for writing\n", filename);
+		return;
+	}
+
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png_ptr == NULL) {
+		fprintf(stderr, "Could not allocate write struct\n");
+	}
+
+	info_ptr = png_create_info_struct(png_ptr);
+	if (info_ptr == NULL) {
+		fprintf(stderr, "Could not allocate info struct\n");
+	}
+
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		fprintf(stderr, "Error during png creation\n");
+	}
+
+	png_init_io(png_ptr, fp);
+
+	// Write header (1 bit grayscale)
+	png_set_IHDR(png_ptr, info_ptr, bm.width, bm.height,
+			1, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+
+	png_write_info(png_ptr, info_ptr);
+
+	// The raster keeps the leftmost pixel in the lowest bit and 1 for a set pixel,
+	// while PNG expects the leftmost pixel in the highest bit and 1 for white.
+	png_set_packswap(png_ptr);
+	png_set_invert_mono(png_ptr);
+
+	// Write image data, splitting the words into bytes from the lowest one
+	std::vector<png_byte> row(8 * bm.stride);
+	for (int y=0 ; y<bm.height ; y++) {
+		const uint64_t *words = &bm.data[(size_t)y*bm.stride];
+		for (size_t k=0 ; k<row.size() ; k++) {
+			row[k] = (png_byte) (words[k/8] >> (8*(k%8)));
+		}
+		png_write_row(png_ptr, row.data());
+	}
+
+	png_write_end(png_ptr, NULL);
+
+	if (fp != NULL) fclose(fp);
+	if (info_ptr != NULL) png_free_data(png_ptr, info_ptr, PNG_FREE_ALL, -1);
+	if (png_ptr != NULL) png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
+}
+
+
+// write the evaluation time of a profile as a heatmap
+// Times are in log scale from the fastest pixel (black) through red and yellow to the slowest one (white).
+void writeHeatmap(const char *filename, const Profile &prof) {
+  float tmin = 0, tmax = 0;
+  for (float t : prof.time) {
+    if (t <= 0) continue;
+    if (tmin == 0 || t < tmin) tmin = t;
+    if (t > tmax) tmax = t;
+  }
+  double range = (tmax > tmin) ? std::log(tmax / tmin) : 1;
+
+  Palette pal(prof.width, prof.height);
+  for (int y=0 ; y<prof.height ; y++) {
+    for (int x=0 ; x<prof.width ; x++) {
+      float t = prof.time[(size_t)y*prof.width + x];
+      double v = (t > 0) ? std::log(t / tmin) / range : 0;
+      double r = std::fmin(1, std::fmax(0, 3*v)), g = std::fmin(1, std::fmax(0, 3*v-1)), b = std::fmin(1, std::fmax(0, 3*v-2));
+      pal.setColor(x, y, (png_byte)(255*r), (png_byte)(255*g), (png_byte)(255*b));
+    }
+  }
+  writeImage(filename, pal);
+}
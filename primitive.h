@@ -0,0 +1,448 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "iRRAM/lib.h"
+#include "iRRAM/core.h"
+#include "iRRAM.h"
+#include "compact.h"
+#include "euclidean.h"
+
+using namespace iRRAM;
+
+/*
+  Primitive compacts with closed form membership
+
+  member(pt, p) rounds pt to a dyadic point x with error e <= 2^(-p-3)
+  and decides d(x) < t := 3*2^(-p-2) by exact rational comparisons, where d is the distance to the set. Then
+    true  implies  d(pt) < t + e <= 2^-p
+    false implies  d(pt) >= t - e > 2^(-p-1)
+  so no sampling or modulus is needed.
+
+  A primitive is sampled on a grid over its exact bounding box. (check Primitive::sample())
+*/
+
+// squared Euclidean distance
+template <int N>
+RATIONAL RP_d2(const RationalPoint<N> &x, const RationalPoint<N> &y)
+{
+  RATIONAL sum = ZERO;
+  for (int i = 0; i < N; i++)
+    sum += (x[i] - y[i]) * (x[i] - y[i]);
+  return sum;
+}
+
+bool isZero(const RATIONAL &x) { return !(x < ZERO) && !(ZERO < x); }
+
+// squared distance to the simplex spanned by the vertices
+// (at most N+1 of them, e.g. 2 for a segment)
+// The closest point lies in the relative interior of some face, where it is the orthogonal projection
+// base + sum lambda_i e_i of x onto the affine hull of the face, with edges e_i = v_i - base and
+// G lambda = b for the Gram matrix G_ij = e_i.e_j and b_i = e_i.(x-base). Its squared distance to x
+// is then |x-base|^2 - lambda.b. Since G depends only on the vertices, G^-1 is computed here once for each face,
+// and a query only forms b and lambda = G^-1 b; among projections with nonnegative barycentric
+// coordinates, the closest one is taken.
+template <int N>
+class SimplexDistance {
+public:
+  // affinely independent face
+  struct Face {
+    int k;                                          // dimension of the face
+    std::array<int, N + 1> index;                   // vertices of the face, index[0] is the base
+    std::array<RationalPoint<N>, N> e;              // edges from the base
+    std::array<std::array<RATIONAL, N>, N> Ginv;    // inverse of the Gram matrix
+  };
+
+  std::vector<RationalPoint<N>> vertices;
+  std::vector<Face> faces;
+
+  SimplexDistance(const std::vector<RationalPoint<N>> &vertices) {
+    this->vertices = vertices;
+    int m = vertices.size();
+    for (int S = 1; S < (1 << m); S++)
+    {
+      Face face;
+      int size = 0;
+      for (int j = 0; j < m; j++)
+        if (S & (1 << j))
+          face.index[size++] = j;
+      face.k = size - 1;
+      int k = face.k;
+      const RationalPoint<N> &base = vertices[face.index[0]];
+      for (int i = 0; i < k; i++)
+        for (int l = 0; l < N; l++)
+          face.e[i][l] = vertices[face.index[i + 1]][l] - base[l];
+
+      // Gauss-Jordan elimination on [G | I]; skip affinely dependent faces
+      std::vector<std::vector<RATIONAL>> A(k, std::vector<RATIONAL>(2 * k, ZERO));
+      for (int i = 0; i < k; i++)
+      {
+        for (int j = 0; j < k; j++)
+          for (int l = 0; l < N; l++)
+            A[i][j] += face.e[i][l] * face.e[j][l];
+        A[i][k + i] = ONE;
+      }
+      bool singular = false;
+      for (int c = 0; c < k; c++)
+      {
+        int pivot = c;
+        while (pivot < k && isZero(A[pivot][c]))
+          pivot++;
+        if (pivot == k)
+        {
+          singular = true;
+          break;
+        }
+        std::swap(A[c], A[pivot]);
+        RATIONAL inv = ONE / A[c][c];
+        for (int j = 0; j < 2 * k; j++)
+          A[c][j] = A[c][j] * inv;
+        for (int r = 0; r < k; r++)
+        {
+          if (r == c || isZero(A[r][c]))
+            continue;
+          RATIONAL ratio = A[r][c];
+          for (int j = 0; j < 2 * k; j++)
+            A[r][j] = A[r][j] - ratio * A[c][j];
+        }
+      }
+      if (singular)
+        continue;
+      for (int i = 0; i < k; i++)
+        for (int j = 0; j < k; j++)
+          face.Ginv[i][j] = A[i][k + j];
+      this->faces.push_back(face);
+    }
+  }
+
+  RATIONAL dist2(const RationalPoint<N> &x) const
+  {
+    // x - v and |x - v|^2 for every vertex v, shared by the faces with the same base
+    int m = this->vertices.size();
+    std::array<RationalPoint<N>, N + 1> y;
+    std::array<RATIONAL, N + 1> y2;
+    for (int j = 0; j < m; j++)
+    {
+      y2[j] = ZERO;
+      for (int l = 0; l < N; l++)
+      {
+        y[j][l] = x[l] - this->vertices[j][l];
+        y2[j] += y[j][l] * y[j][l];
+      }
+    }
+
+    RATIONAL best = ZERO;
+    bool found = false;
+    std::array<RATIONAL, N> b, lambda;
+    for (const Face &face : this->faces)
+    {
+      int k = face.k, v = face.index[0];
+      for (int i = 0; i < k; i++)
+      {
+        b[i] = ZERO;
+        for (int l = 0; l < N; l++)
+          b[i] += face.e[i][l] * y[v][l];
+      }
+
+      // barycentric coordinates must be nonnegative
+      RATIONAL d2 = y2[v], mu0 = ONE;
+      bool inside = true;
+      for (int i = 0; i < k && inside; i++)
+      {
+        lambda[i] = ZERO;
+        for (int j = 0; j < k; j++)
+          lambda[i] += face.Ginv[i][j] * b[j];
+        if (lambda[i] < ZERO)
+          inside = false;
+        mu0 = mu0 - lambda[i];
+        d2 = d2 - lambda[i] * b[i];
+      }
+      if (!inside || mu0 < ZERO)
+        continue;
+
+      if (!found || d2 < best)
+        best = d2;
+      found = true;
+    }
+    return best;
+  }
+};
+
+
+// sqrt of an exact square distance d2 >= 0
+inline REAL distanceOf2(const RATIONAL &d2) {
+  if(!(ZERO < d2)) return REAL(0);
+  return sqrt(REAL(d2));
+}
+
+
+template <int N>
+class Primitive : public Compact<N> {
+public:
+  // whether the distance from an exact point x to the set is less than t > 0
+  virtual bool within(const RationalPoint<N> &x, const RATIONAL &t) = 0;
+
+  // distance from an exact point x to the nonempty set
+  // distance() and hausdorff() use it instead of sampling the set.
+  virtual REAL distanceTo(const RationalPoint<N> &x) = 0;
+
+  // exact bounding box [lo[0],hi[0]] X ... X [lo[N-1],hi[N-1]] of the set
+  // Return false if the set is empty.
+  virtual bool exactBox(RationalPoint<N> &lo, RationalPoint<N> &hi) = 0;
+
+  // membership test for point with precision 2^-p
+  // in accordance to the Ko compatibility
+  bool member(const Point<N> &point, int p) {
+    // error of each coordinate 2^(-p-3-h), where sqrt(N) <= 2^h
+    RationalPoint<N> x = dyadicApprox<N>(point, p+3+sqrtExponent(N));
+
+    return within(x, RATIONAL(INTEGER(3)) * Exp(-p-2));
+  }
+
+  bool boundingBox(Box<N> &box) {
+    RationalPoint<N> lo, hi;
+    if(!this->exactBox(lo, hi)) return false;
+    for(int i=0 ; i<N ; i++) {
+      box.lo[i] = REAL(lo[i]);
+      box.hi[i] = REAL(hi[i]);
+    }
+    return true;
+  }
+
+  // the points of the grid of side g = 2^(-p-2-h), sqrt(N) <= 2^h, covering the box,
+  // whose distances to the set are less than 2^(-p-1)
+  // Every point of the set is within sqrt(N)*g/2 <= 2^(-p-3) of a grid point, which is then taken.
+  // The number of points grows as 2^(N*p) times the volume of the box.
+  bool sample(int p, std::vector<Point<N>> &points) {
+    points.clear();
+    RationalPoint<N> lo, hi;
+    if(!this->exactBox(lo, hi)) return true;
+
+    RATIONAL g = Exp(-p-2-sqrtExponent(N)), t = Exp(-p-1);
+    RationalPoint<N> x = lo;
+    while(true) {
+      if(this->within(x, t)) {
+        Point<N> pt;
+        for(int i=0 ; i<N ; i++) pt[i] = REAL(x[i]);
+        points.push_back(pt);
+      }
+
+      // next grid point, the first coordinate running fastest
+      // On each axis, the last one is at hi or beyond.
+      int i = 0;
+      for( ; i<N ; i++) {
+        if(x[i] < hi[i]) {
+          x[i] += g;
+          break;
+        }
+        x[i] = lo[i];
+      }
+      if(i == N) break;
+    }
+    return true;
+  }
+};
+
+
+// closed ball with center c and radius r >= 0
+template <int N>
+class Ball : public Primitive<N> {
+public:
+  RationalPoint<N> c;
+  RATIONAL r;
+
+  Ball(const RationalPoint<N> &c, const RATIONAL &r) { this->c = c; this->r = r; }
+
+  // d(x) = max(|x-c| - r, 0) < t  iff  |x-c| < r + t
+  bool within(const RationalPoint<N> &x, const RATIONAL &t) {
+    RATIONAL rt = this->r + t;
+    return RP_d2<N>(x, this->c) < rt * rt;
+  }
+
+  REAL distanceTo(const RationalPoint<N> &x) {
+    RATIONAL d2 = RP_d2<N>(x, this->c);
+    if(!(this->r * this->r < d2)) return REAL(0);
+    return sqrt(REAL(d2)) - REAL(this->r);
+  }
+
+  bool exactBox(RationalPoint<N> &lo, RationalPoint<N> &hi) {
+    for(int i=0 ; i<N ; i++) {
+      lo[i] = this->c[i] - this->r;
+      hi[i] = this->c[i] + this->r;
+    }
+    return true;
+  }
+};
+
+// singleton {c}
+template <int N>
+class Singleton : public Ball<N> {
+public:
+  Singleton(const RationalPoint<N> &c) : Ball<N>(c, ZERO) {}
+};
+
+
+// axis-aligned box [lo[0],hi[0]] X ... X [lo[N-1],hi[N-1]]
+// For N = 1, this is a closed interval.
+template <int N>
+class AlignedBox : public Primitive<N> {
+public:
+  RationalPoint<N> lo, hi;
+
+  // REQUIRE: lo[i] <= hi[i]
+  AlignedBox(const RationalPoint<N> &lo, const RationalPoint<N> &hi) { this->lo = lo; this->hi = hi; }
+
+  // square distance from x
+  RATIONAL dist2(const RationalPoint<N> &x) const {
+    RATIONAL sum = ZERO;
+    for(int i=0 ; i<N ; i++) {
+      if(x[i] < this->lo[i]) sum += (this->lo[i] - x[i]) * (this->lo[i] - x[i]);
+      else if(this->hi[i] < x[i]) sum += (x[i] - this->hi[i]) * (x[i] - this->hi[i]);
+    }
+    return sum;
+  }
+
+  bool within(const RationalPoint<N> &x, const RATIONAL &t) { return this->dist2(x) < t * t; }
+
+  REAL distanceTo(const RationalPoint<N> &x) { return distanceOf2(this->dist2(x)); }
+
+  bool exactBox(RationalPoint<N> &lo, RationalPoint<N> &hi) {
+    lo = this->lo;
+    hi = this->hi;
+    return true;
+  }
+};
+
+
+// hull of vertices of a finite set of points
+template <int N>
+bool verticesBox(const std::vector<RationalPoint<N>> &vertices, RationalPoint<N> &lo, RationalPoint<N> &hi) {
+  if(vertices.empty()) return false;
+  lo = vertices[0];
+  hi = vertices[0];
+  for(const RationalPoint<N> &v : vertices) {
+    for(int i=0 ; i<N ; i++) {
+      if(v[i] < lo[i]) lo[i] = v[i];
+      if(hi[i] < v[i]) hi[i] = v[i];
+    }
+  }
+  return true;
+}
+
+
+// simplex spanned by at most N+1 vertices; possibly degenerate
+template <int N>
+class Simplex : public Primitive<N> {
+public:
+  std::vector<RationalPoint<N>> vertices;
+  SimplexDistance<N> distance;
+
+  Simplex(const std::vector<RationalPoint<N>> &vertices) : distance(vertices) { this->vertices = vertices; }
+
+  bool within(const RationalPoint<N> &x, const RATIONAL &t) {
+    return this->distance.dist2(x) < t * t;
+  }
+
+  REAL distanceTo(const RationalPoint<N> &x) { return distanceOf2(this->distance.dist2(x)); }
+
+  bool exactBox(RationalPoint<N> &lo, RationalPoint<N> &hi) { return verticesBox<N>(this->vertices, lo, hi); }
+};
+
+// line segment [a, b]
+template <int N>
+class Segment : public Simplex<N> {
+public:
+  Segment(const RationalPoint<N> &a, const RationalPoint<N> &b) : Simplex<N>({a, b}) {}
+};
+
+
+// polytope given as a union of simplices, e.g. a triangulation; need not be convex
+template <int N>
+class Polytope : public Primitive<N> {
+public:
+  std::vector<std::vector<RationalPoint<N>>> simplices;
+  std::vector<SimplexDistance<N>> distances;      // of each simplex
+
+  Polytope(const std::vector<std::vector<RationalPoint<N>>> &simplices) {
+    this->simplices = simplices;
+    for(const std::vector<RationalPoint<N>> &s : simplices) this->distances.push_back(SimplexDistance<N>(s));
+  }
+
+  bool within(const RationalPoint<N> &x, const RATIONAL &t) {
+    RATIONAL t2 = t * t;
+    for(const SimplexDistance<N> &s : this->distances)
+      if(s.dist2(x) < t2) return true;
+    return false;
+  }
+
+  REAL distanceTo(const RationalPoint<N> &x) {
+    RATIONAL best = this->distances[0].dist2(x);
+    for(const SimplexDistance<N> &s : this->distances) {
+      RATIONAL d2 = s.dist2(x);
+      if(d2 < best) best = d2;
+    }
+    return distanceOf2(best);
+  }
+
+  bool exactBox(RationalPoint<N> &lo, RationalPoint<N> &hi) {
+    std::vector<RationalPoint<N>> all;
+    for(const std::vector<RationalPoint<N>> &s : this->simplices)
+      all.insert(all.end(), s.begin(), s.end());
+    return verticesBox<N>(all, lo, hi);
+  }
+};
+
+
+// simple polygon in the plane with its interior, vertices given in order
+class Polygon : public Primitive<2> {
+public:
+  std::vector<RationalPoint<2>> vertices;
+  std::vector<SimplexDistance<2>> edges;          // edges[k] from vertices[k] to the next one
+
+  Polygon(const std::vector<RationalPoint<2>> &vertices) {
+    this->vertices = vertices;
+    int m = vertices.size();
+    for(int k=0 ; k<m ; k++) this->edges.push_back(SimplexDistance<2>({vertices[k], vertices[(k+1)%m]}));
+  }
+
+  // whether x is in the interior, or on the boundary for some edges
+  // The ray from x to the right crosses the boundary an odd number of times.
+  // Exact comparisons make the usual half-open rule on vertices work.
+  // x[0] < crossing of the edge  iff  (x[0]-a[0])*(b[1]-a[1]) < (x[1]-a[1])*(b[0]-a[0]) when b[1] > a[1]
+  bool inside(const RationalPoint<2> &x) const {
+    int m = this->vertices.size();
+    bool inside = false;
+    for(int k=0 ; k<m ; k++) {
+      const RationalPoint<2> &a = this->vertices[k], &b = this->vertices[(k+1)%m];
+      if((x[1] < a[1]) != (x[1] < b[1])) {
+        RATIONAL lhs = (x[0] - a[0]) * (b[1] - a[1]), rhs = (x[1] - a[1]) * (b[0] - a[0]);
+        if(a[1] < b[1] ? lhs < rhs : rhs < lhs) inside = !inside;
+      }
+    }
+    return inside;
+  }
+
+  bool within(const RationalPoint<2> &x, const RATIONAL &t) {
+    if(this->vertices.empty()) return false;
+
+    // near the boundary
+    RATIONAL t2 = t * t;
+    for(const SimplexDistance<2> &edge : this->edges)
+      if(edge.dist2(x) < t2) return true;
+
+    return this->inside(x);
+  }
+
+  REAL distanceTo(const RationalPoint<2> &x) {
+    if(this->inside(x)) return REAL(0);
+    RATIONAL best = this->edges[0].dist2(x);
+    for(const SimplexDistance<2> &edge : this->edges) {
+      RATIONAL d2 = edge.dist2(x);
+      if(d2 < best) best = d2;
+    }
+    return distanceOf2(best);
+  }
+
+  bool exactBox(RationalPoint<2> &lo, RationalPoint<2> &hi) { return verticesBox<2>(this->vertices, lo, hi); }
+};
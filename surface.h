@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <stdexcept>
 
 #include "iRRAM/lib.h"
 #include "iRRAM/core.h"
@@ -22,10 +23,34 @@ public:
   // init
   Surface(std::function<Point<N>(REAL,REAL)> f) { this->f = f; }
 
+  // init with a Lipschitz constant L of f, i.e. |f(x)-f(z)| <= L|x-z| for all x,z in [0,1]^2
+  // pArg is then computed directly, without the search in module2.
+  Surface(std::function<Point<N>(REAL,REAL)> f, REAL L) : Surface(f) {
+    this->lipschitz = L;
+    this->lipschitzKnown = true;
+  }
+
+  // init with the partial derivatives (df/du, df/dv) of f
+  // A Lipschitz constant is obtained by evaluating them on [0,1]^2.
+  Surface(std::function<Point<N>(REAL,REAL)> f, std::function<std::array<Point<N>,2>(REAL,REAL)> df) : Surface(f) {
+    std::function<std::array<Point<N>,2>(Point<2>)> J = [=](Point<2> x) -> std::array<Point<N>,2> {
+      return df(x[0], x[1]);
+    };
+    this->lipschitz = derivativeBound<2,N>(J);
+    this->lipschitzKnown = true;
+  }
+
+  // a certified Lipschitz constant of f, if known
+  REAL lipschitz;
+  bool lipschitzKnown = false;
+
   // whenever |x-z| < 2^-pArg, |f(x)-f(z)| < 2^-p for all x,z
   // will be increased when higher precision is requested
   int p=INT_MIN, pArg=INT_MIN;
 
+  // indices of the center of the last ball that contained a point
+  std::array<long long,2> lastHit = {0, 0};
+
   // increase the current precision(from this->p to p)
   // and find the corresponding pArg
   void increasePrecision(int p) {
@@ -39,13 +64,22 @@ public:
     std::function<Point<N>(Point<2>)> ff = [=](Point<2> x) -> Point<N> {
       return this->f(x[0], x[1]);
     };
-    this->pArg = module2<2,N>(ff, p+1);
+    // pArg is cached, so the search is not repeated when compute() is reiterated
+    int q;
+    if(!cacheGet(q)) {
+      q = this->lipschitzKnown ? lipschitzModule<2>(this->lipschitz, p+1) : module2<2,N>(ff, p+1);
+      cachePut(q);
+    }
+    // balls are indexed by long long, ku*n + kv
+    if(q > 31) throw std::range_error("Surface: more than 2^62 balls are needed");
+    this->pArg = q;
+    this->lastHit = {0, 0};
 
     // update the current precision
     this->p = p;
 
     // update the current characteristic function
-    this->cfun = [&](Point<N> pt, int p) {
+    this->cfun = [&](const Point<N> &pt, int p) {
       single_valued code;
 
       // check the membership with previously found p and pArg
@@ -54,24 +88,115 @@ public:
       // maximum distance between two consecutive balls(centers): 2^(-p-1)*sqrt(2)   (check increasePrecision())
       // When checking inclusiveness, we run (d < radius) and (d > radius/2) in parallel for decidability.
       // For any point on the path, there exists a ball that contains the point.
-      RATIONAL step = Exp(-pArg);   // 2^-pArg
-      RATIONAL radius = Exp(-p);     // 2^-p, the radius of a ball
-      RATIONAL radiusHalf = radius/INTEGER(2);     // 2^(-p-1)
-      REAL d;
-      RATIONAL u,v;
-      for(u=step/2 ; u<=ONE ; u+=step) {
-        for(v=step/2 ; v<=ONE ; v+=step) {
-          d = IR_d<N>(pt, this->f(u, v));
-          if(choose(d < radius, d > radiusHalf) == 1) return true;
+      // Distances are compared squared, to the constants kept for the last p.
+      // With the centers around the last hit cached (check ballCenter()), little is rebuilt per call.
+      if(this->radiusP != p) {
+        this->radius2 = Exp(-2*p);          // (2^-p)^2, the radius of a ball squared
+        this->radiusHalf2 = Exp(-2*p-2);    // (2^(-p-1))^2
+        this->radiusP = p;
+      }
+      REAL d2;
+
+      // centers f(step/2 + ku*step, step/2 + kv*step) are scanned in square rings around the last hit
+      // Neighbouring points are mostly covered by the same or adjacent balls.
+      long long n = 1LL << pArg;     // number of centers on each axis
+      long long hu = this->lastHit[0], hv = this->lastHit[1];
+      for(long long r=0 ; r<n ; r++) {
+        for(long long du=-r ; du<=r ; du++) {
+          long long ku = hu+du;
+          if(ku < 0 || ku >= n) continue;
+          // whole column on the left and right sides; only the top and bottom otherwise
+          long long dvStep = (du == -r || du == r) ? 1 : 2*r;
+          for(long long dv=-r ; dv<=r ; dv+=dvStep) {
+            long long kv = hv+dv;
+            if(kv < 0 || kv >= n) continue;
+            profileCounters.centers++;
+            d2 = IR_d2<N>(pt, this->ballCenter(ku, kv));
+            if(choose(d2 < this->radius2, d2 > this->radiusHalf2) == 1) {
+              this->lastHit = {ku, kv};
+              return true;
+            }
+          }
         }
       }
       return false;
     };
   }
+
+  // centers of balls at the current precision, the (ku,kv)'th one in the slot (ku mod S, kv mod S)
+  // with S = CENTER_CACHE_SIDE
+  // A slot keeps the last center evaluated in it, so the rings around the last hit mostly find
+  // theirs, and the memory stays bounded whatever pArg is.
+  std::vector<Point<N>> centers;
+  std::vector<long long> centerKeys;    // index ku*n + kv of the center in each slot, -1 if none
+  RATIONAL halfStep;                    // 2^(-pArg-1), half the step between the parameters of two centers
+  int centersP = INT_MIN;
+
+  // squared radii used by the characteristic function for the precision radiusP
+  REAL radius2, radiusHalf2;
+  int radiusP = INT_MIN;
+
+  // f(step/2 + ku*step, step/2 + kv*step), the center of the (ku,kv)'th ball
+  const Point<N> &ballCenter(long long ku, long long kv) {
+    if(this->centersP != this->p) {
+      this->centers.resize(CENTER_CACHE_SIDE * CENTER_CACHE_SIDE);
+      this->centerKeys.assign(CENTER_CACHE_SIDE * CENTER_CACHE_SIDE, -1);
+      this->halfStep = Exp(-pArg-1);
+      this->centersP = this->p;
+    }
+    long long n = 1LL << pArg;     // number of centers on each axis
+    int slot = (ku % CENTER_CACHE_SIDE) * CENTER_CACHE_SIDE + kv % CENTER_CACHE_SIDE;
+    if(this->centerKeys[slot] != ku*n + kv) {
+      this->centers[slot] = this->f(this->halfStep * RATIONAL(toINTEGER(2*ku+1)),
+                                    this->halfStep * RATIONAL(toINTEGER(2*kv+1)));
+      this->centerKeys[slot] = ku*n + kv;
+    }
+    return this->centers[slot];
+  }
+
+  // The centers at precision q are within sqrt(N)*2^(-q-1) of every point. (check increasePrecision())
+  // Hence q = p+h with sqrt(N) <= 2^h will do.
+  bool sample(int p, std::vector<Point<N>> &points) {
+    this->increasePrecision(p+sqrtExponent(N));
+    long long n = 1LL << pArg;     // number of centers on each axis
+    points.clear();
+    for(long long ku=0 ; ku<n ; ku++)
+      for(long long kv=0 ; kv<n ; kv++) points.push_back(this->ballCenter(ku, kv));
+    return true;
+  }
   
+  // certified bounding box of the surface
+  // Any precision will do, so the current one is used when there is.
+  bool boundingBox(Box<N> &box) {
+    if(this->p == INT_MIN) this->increasePrecision(0);
+
+    // the hull of the centers of balls
+    RATIONAL step = Exp(-pArg);
+    RATIONAL u,v;
+    bool first = true;
+    for(u=step/2 ; u<=ONE ; u+=step) {
+      for(v=step/2 ; v<=ONE ; v+=step) {
+        Point<N> c = this->f(u, v);
+        for(int i=0 ; i<N ; i++) {
+          box.lo[i] = first ? c[i] : minimum(box.lo[i], c[i]);
+          box.hi[i] = first ? c[i] : maximum(box.hi[i], c[i]);
+        }
+        first = false;
+      }
+    }
+
+    // On each axis, every point is within 2^(-p-1) of the center of its cell. (check increasePrecision())
+    REAL margin = Exp(-this->p-1);
+    for(int i=0 ; i<N ; i++) {
+      box.lo[i] -= margin;
+      box.hi[i] += margin;
+    }
+    return true;
+  }
+
   // membership test for point with precision 2^-p
   // in accordance to the Ko compatibility
-  bool member(Point<N> point, int p) {
+  bool member(const Point<N> &point, int p) {
     // check if previously found pArg is viable
     // if not, increase the precision
     if(this->p < p) this->increasePrecision(p);